@@ -18,97 +18,38 @@ int badArgCount( char * cmdName )
     return -1;
 }
 
-////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 // int <--> symbolic translations
-// declare it in PROGMEM so strings are not copied to RAM
-//
-// NOTE: PROGMEM access to values in this struct
-// is not as simple as it would be in RAM.
-// But const strings in RAM can take significant space.
+// kept in PROGMEM (names included) so nothing is copied to RAM,
+// and sorted by name so lookups can use a binary search
 //
-struct lookupVals
-{
-#ifdef AVR
-    const char * PROGMEM name_pp;
-#else
-    const char * name_pp;
-#endif
-    int val;
-    __FlashStringHelper * getNamePtr(void) const
-    {
-        auto nameInProgmem = &(name_pp);
-        __FlashStringHelper * fshName
-            = (__FlashStringHelper *)pgm_read_ptr(nameInProgmem);
-        return fshName;
-    }
-    String getName(void) const
-    {
-        auto fshName = getNamePtr();
-        return String(fshName);
-    };
-    int getValue(void) const
-    {
-        auto valInProgmem = &(val);
-        return pgm_read_word(valInProgmem);
-    }
+static constexpr SimpleSerialShell::Symbol modes[] PROGMEM = {
+    {"input", INPUT},
+    {"output", OUTPUT},
+    {"pullup", INPUT_PULLUP},
 };
+static_assert(SimpleSerialShell::symbolsSorted(modes), "modes must be sorted by name");
 
-////////////////////////////////////////////////////////////////////////////////
-int lookup(const char * aName, const lookupVals entries[])
+template <size_t N>
+int badSymbol(char * cmdName, const SimpleSerialShell::Symbol (&table)[N])
 {
-    int i = 0;
-    String name(aName);
-    //Serial << F("looking up \"") << name << F("\"") << endl;
-    for (; entries[i].getNamePtr(); i++)
-    {
-        //Serial << F(" i = ") << i
-        //       << F(" comparing against ") << entries[i].getName() << endl;
-        if (name.equalsIgnoreCase(entries[i].getName())) {
-            auto aVal = entries[i].getValue();
-            //Serial << F("found entry: ") << aVal << endl;
-            return aVal;
-            break;
-        }
-    }
-    auto v = entries[0].getValue();
-    //Serial << "giving up; using" << v << endl;
-    return v;
-}
-
-////////////////////////////////////////////////////////////////////////////////
-String reverseLookup(int aVal, const lookupVals entries[])
-{
-    //Serial << F("Looking up ") << aVal << endl;
-    for (int i = 0; entries[i].getNamePtr(); i++)
-    {
-        //Serial << F(" i = ") << i
-        //       << F(" comparing against ") << entries[i].getName() << endl;
-        if (aVal == entries[i].getValue()) {
-            return entries[i].getName();
-            break;
-        }
-    }
-    return String(F("(unrecognized value)"));
+    shell.print(cmdName);
+    shell.print(F(": expected "));
+    SimpleSerialShell::printSymbols(shell, table);
+    shell.println();
+    return -1;
 }
 
-////////////////////////////////////////////////////////////////////////////////
-static const char input_s[] PROGMEM = "input";
-static const char output_s[] PROGMEM = "output";
-static const char pullup_s[] PROGMEM = "pullup";
-static const lookupVals modes[] PROGMEM = {
-    {input_s, INPUT},
-    {output_s, OUTPUT},
-    {pullup_s, INPUT_PULLUP},
-    {NULL, INPUT} // end of list
-};
-
 int setPinMode(int argc, char **argv)
 {
     if (argc == 3)
     {
         auto pin = atoi(argv[1]);
-        auto mode = lookup(argv[2], modes);
+        int mode;
+        if (!SimpleSerialShell::lookupSymbol(argv[2], modes, mode))
+        {
+            return badSymbol(argv[0], modes);
+        }
 
         pinMode(pin, mode);
         return EXIT_SUCCESS;
@@ -125,18 +66,67 @@ int analogRead(int argc, char **argv)
         int pin = atoi(argv[1]);
         if (pin < 0 || pin > (int) NUM_ANALOG_INPUTS)
         {
-            shell.print(F("pin "));
-            shell.print(pin);
-            shell.println(F(" does not look like an analog pin"));
+            shell.printf(F("pin %d does not look like an analog pin\r\n"), pin);
         }
-        auto val = analogRead(pin);
-        shell.println(val);
+        // "pin: 0, value: 512", or JSON/CSV after "format json"
+        shell.beginRecord(F("analog"));
+        shell.field(F("pin"), pin);
+        shell.field(F("value"), analogRead(pin));
+        shell.endRecord();
         return EXIT_SUCCESS;
     }
 
     return badArgCount(argv[0]);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// stream analog readings as binary telemetry frames (see shell.subscribe())
+// -- several times faster than printing them
+//
+static SimpleSerialShell::Subscription subscriptions[2];
+
+static uint8_t sampleAnalogPins(int16_t values[], unsigned long pinMask)
+{
+    uint8_t count = 0;
+    for (int pin = 0; pinMask && count < SIMPLE_SERIAL_SHELL_TELEMETRY_VALUES;
+            pin++, pinMask >>= 1) {
+        if (pinMask & 1) {
+            values[count++] = analogRead(pin);
+        }
+    }
+    return count;
+}
+
+int analogStream(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        return badArgCount(argv[0]);
+    }
+    unsigned long period = atol(argv[1]);
+    unsigned long pinMask = 0;
+    for (int i = 2; i < argc; i++)
+    {
+        int pin = atoi(argv[i]);
+        if (pin < 0 || pin >= (int) NUM_ANALOG_INPUTS)
+        {
+            shell.printf(F("pin %d does not look like an analog pin\r\n"), pin);
+            return -1;
+        }
+        pinMask |= 1UL << pin;
+    }
+
+    int id = shell.subscribe(sampleAnalogPins, pinMask, period);
+    if (id < 0)
+    {
+        shell.println(F("too many subscriptions"));
+        return -1;
+    }
+    shell.print(F("subscription "));
+    shell.println(id);
+    return EXIT_SUCCESS;
+}
+
 #ifndef ARDUINO_ARCH_ESP32
 ////////////////////////////////////////////////////////////////////////////////
 int analogWrite(int argc, char **argv)
@@ -146,9 +136,7 @@ int analogWrite(int argc, char **argv)
         int pin = atoi(argv[1]);
         if (!digitalPinHasPWM(pin))
         {
-            shell.print(F("pin "));
-            shell.print(pin);
-            shell.println(F(" does not look like an analog output"));
+            shell.printf(F("pin %d does not look like an analog output\r\n"), pin);
         }
         int val = atoi(argv[2]);
 
@@ -161,17 +149,12 @@ int analogWrite(int argc, char **argv)
 #endif
 
 ////////////////////////////////////////////////////////////////////////////////
-const char low_s[] PROGMEM = "low";
-const char high_s[] PROGMEM = "high";
-const char zero_s[] PROGMEM = "0";
-const char one_s[] PROGMEM = "1";
-const lookupVals digLevels[] PROGMEM = {
-    {low_s, LOW},
-    {high_s, HIGH},
-    {zero_s, LOW},
-    {one_s, HIGH},
-    {NULL, LOW} // end of list
+// (0 and 1 are accepted as numbers)
+static constexpr SimpleSerialShell::Symbol digLevels[] PROGMEM = {
+    {"high", HIGH},
+    {"low", LOW},
 };
+static_assert(SimpleSerialShell::symbolsSorted(digLevels), "digLevels must be sorted by name");
 ////////////////////////////////////////////////////////////////////////////////
 int digitalWrite(int argc, char **argv)
 {
@@ -180,11 +163,17 @@ int digitalWrite(int argc, char **argv)
         int pin = atoi(argv[1]);
         if (pin < 0 || pin >= (int) NUM_DIGITAL_PINS)
         {
-            shell.print(F("pin "));
-            shell.print(pin);
-            shell.println(F(" does not look like a digital pin"));
+            shell.printf(F("pin %d does not look like a digital pin\r\n"), pin);
+        }
+        int level;
+        if (isdigit(argv[2][0]))
+        {
+            level = atoi(argv[2]) ? HIGH : LOW;
+        }
+        else if (!SimpleSerialShell::lookupSymbol(argv[2], digLevels, level))
+        {
+            return badSymbol(argv[0], digLevels);
         }
-        auto level = lookup(argv[2], digLevels);
 
         digitalWrite(pin, level);
         return EXIT_SUCCESS;
@@ -201,15 +190,11 @@ int digitalRead(int argc, char **argv)
         int pin = atoi(argv[1]);
         if (pin < 0 || pin >= (int) NUM_DIGITAL_PINS)
         {
-            shell.print(F("pin "));
-            shell.print(pin);
-            shell.println(F(" does not look like a digital pin"));
+            shell.printf(F("pin %d does not look like a digital pin\r\n"), pin);
         }
         auto val = digitalRead(pin);
-        shell.print(val);
-        shell.print(F(" "));
-        auto valName = reverseLookup(val, digLevels);
-        shell.println(valName);
+        auto valName = SimpleSerialShell::symbolName(val, digLevels);
+        shell.printf(F("%d %S\r\n"), val, valName ? valName : F("(unrecognized value)"));
 
         return EXIT_SUCCESS;
     }
@@ -276,6 +261,8 @@ int addArduinoCommands(SimpleSerialShell & shell)
     ADD_COMMAND("digitalwrite", "pinNumber {low|high|0|1}", digitalWrite);
     ADD_COMMAND("digitalread", "pinNumber", digitalRead);
     ADD_COMMAND("analogread", "pinNumber", analogRead);
+    ADD_COMMAND("analogstream", "periodMillisec pinNumber...", analogStream);
+    shell.addTelemetryCommands(subscriptions, 2);   // "unsubscribe"
 
 #ifndef ARDUINO_ARCH_ESP32
     ADD_COMMAND("analogwrite", "pinNumber value", analogWrite);
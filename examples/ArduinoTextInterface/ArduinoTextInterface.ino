@@ -35,6 +35,7 @@ void setup() {
     shell.attach(Serial);
     //shell.addCommand(F("echo"), echo);
     shell.addCommand(F("id?"), showID);
+    shell.addFormatCommand();   // "format json" for host tools
 
     addArduinoCommands(shell);
     addMemoryCommands(shell);
@@ -47,27 +47,18 @@ long parseAsHex(const char *aValue)
     return value;
 }
 
-////////////////////////////////////////////////////////////////////////////////
-void prettyPrintChars(int lineNo, const char *chars, int numChars)
+#ifdef AVR
+static uint8_t readEeprom(unsigned long address)
 {
-    shell.print(lineNo, HEX);
-    for (int j = 0; j < numChars; j++) {  // hex values
-        unsigned char b = chars[j];
-        shell.print(F(" "));
-        if(b < 0x10) {
-            shell.print(F("0"));
-        }
-        shell.print(b, HEX);
-    }
-    shell.print(F(" "));
-    for (int j = 0; j < numChars; j++) {  // text values
-        char b = chars[j];
-        bool printIt = isPrintable(b);
-        shell.print(printIt ? b : '.');
-    }
-    shell.println();
+    return EEPROM.read(address);
 }
 
+static void writeEeprom(unsigned long address, uint8_t value)
+{
+    EEPROM.update(address, value);
+}
+#endif
+
 static const int rowSize = 0x10;
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -76,11 +67,16 @@ static const int rowSize = 0x10;
 int dumpAMemory(int argc, char **argv)
 {
     const char dumperNameStarts = tolower(argv[0][0]);
-    bool dumpingRAM = (dumperNameStarts == 'r');
+    SimpleSerialShell::ByteReader reader = SimpleSerialShell::readRam;
+    if (dumperNameStarts == 'p') {
+        reader = SimpleSerialShell::readProgmem;
+    }
 #ifdef AVR
     bool dumpingEEPROM = (dumperNameStarts == 'e');
+    if (dumpingEEPROM) {
+        reader = readEeprom;
+    }
 #endif
-    bool dumpingPROGMEM = (dumperNameStarts == 'p');
 
     int begin = 0;
     if (argc > 1) {
@@ -104,32 +100,92 @@ int dumpAMemory(int argc, char **argv)
         end = begin + numBytes;
     }
 
-    char aLine[rowSize];
-    for (int i = begin; i < end; i += rowSize) {
-        for (int j = 0; j < rowSize; j++) {
-            char b = 0;
-            if (dumpingPROGMEM) {
-                b = pgm_read_byte( (void *) (i + j));
-            }
-            if (dumpingRAM) {
-                const char *allRam = (char *) i;
-                b = allRam[j];
-            }
+    // whole rows, as before
+    unsigned long length = (end > begin) ? end - begin : 0;
+    length = (length + rowSize - 1) / rowSize * rowSize;
+    return shell.dump(reader, begin, length);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// block transfers: binary, for host tools (see SimpleSerialShell::beginTransfer())
+//
+// "blockread ram 100 200" sends 0x200 bytes from address 0x100;
+// "blockwrite eeprom 0 40" receives 0x40 bytes for the start of EEPROM.
+//
+static SimpleSerialShell::BlockTransfer transfer;
+static SimpleSerialShell::ByteReader blockReader;   // (one transfer at a time)
+static SimpleSerialShell::ByteWriter blockWriter;
+
+// parses "<memory> <beginHex> <numBytesHex>", returning the memory's initial
+static char parseBlock(int argc, char **argv, long & begin, long & numBytes)
+{
+    if (argc != 4) {
+        return 0;
+    }
+    begin = parseAsHex(argv[2]);
+    numBytes = parseAsHex(argv[3]);
+    return (begin < 0 || numBytes < 0) ? 0 : tolower(argv[1][0]);
+}
+
+int blockRead(int argc, char **argv, SimpleSerialShell::AsyncState & state)
+{
+    SHELL_ASYNC_BEGIN(state);
+    {
+        long begin, numBytes;
+        char memory = parseBlock(argc, argv, begin, numBytes);
+        blockReader = NULL;
+        if (memory == 'r') {
+            blockReader = SimpleSerialShell::readRam;
+        } else if (memory == 'p') {
+            blockReader = SimpleSerialShell::readProgmem;
+        }
 #ifdef AVR
-            if (dumpingEEPROM) {
-                b = EEPROM.read(i + j);
-            }
+        if (memory == 'e') {
+            blockReader = readEeprom;
+        }
 #endif
-            aLine[j] = b;
+        if (!blockReader) {
+            return checkSyntax();
         }
-        prettyPrintChars(i, aLine, rowSize);
+        shell.beginTransfer(transfer, begin, numBytes);
     }
-    return 0;
+    SHELL_ASYNC_WAIT_UNTIL(state, (state.locals[0] = shell.sendBlocks(transfer, blockReader))
+                           != SimpleSerialShell::PENDING);
+    SHELL_ASYNC_END(state);
+    return state.locals[0];
+}
+
+int blockWrite(int argc, char **argv, SimpleSerialShell::AsyncState & state)
+{
+    SHELL_ASYNC_BEGIN(state);
+    {
+        long begin, numBytes;
+        char memory = parseBlock(argc, argv, begin, numBytes);
+        blockWriter = NULL;
+        if (memory == 'r') {
+            blockWriter = SimpleSerialShell::writeRam;
+        }
+#ifdef AVR
+        if (memory == 'e') {
+            blockWriter = writeEeprom;
+        }
+#endif
+        if (!blockWriter) {
+            return checkSyntax();
+        }
+        shell.beginTransfer(transfer, begin, numBytes);
+    }
+    SHELL_ASYNC_WAIT_UNTIL(state, (state.locals[0] = shell.receiveBlocks(transfer, blockWriter))
+                           != SimpleSerialShell::PENDING);
+    SHELL_ASYNC_END(state);
+    return state.locals[0];
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 int addMemoryCommands(SimpleSerialShell & shell)
 {
+    shell.addAsyncCommand(F("blockread {ram|progmem|eeprom} <beginHex> <numBytesHex>"), blockRead);
+    shell.addAsyncCommand(F("blockwrite {ram|eeprom} <beginHex> <numBytesHex>"), blockWrite);
 #ifdef AVR
     shell.addCommand(F("eeprom? [<beginHex> [<numBytesHex>]]"), dumpAMemory);
 #endif
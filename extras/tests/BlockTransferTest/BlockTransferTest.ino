@@ -0,0 +1,297 @@
+// BlockTransferTest.ino
+//
+// Move memory to and from the "host" in binary frames (see beginTransfer()),
+// playing the host's part of the protocol here.
+//
+#include <Arduino.h>
+
+// fake it for UnixHostDuino emulation
+#if defined(UNIX_HOST_DUINO)
+#  ifndef ARDUINO
+#  define ARDUINO 100
+#  endif
+#endif
+
+// These tests depend on the Arduino "AUnit" library
+#include <AUnit.h>
+#include "BulkStream.h"
+#include <SimpleSerialShell.h>
+
+using namespace aunit;
+
+static const uint8_t SYNC = 0xB5;
+static const uint8_t ACK = 0x06;
+static const uint8_t NAK = 0x15;
+static const uint8_t CAN = 0x18;
+static const uint8_t BLOCK = SIMPLE_SERIAL_SHELL_BLOCK_SIZE;
+
+static BulkStream terminal(0x1000, 0x1000);
+
+// what the device sends, and where it writes what it is sent
+static uint8_t source[200];
+static uint8_t target[2 * BLOCK];
+static SimpleSerialShell::BlockTransfer transfer;
+
+// the host's copy of what it was sent
+static uint8_t received[sizeof(source)];
+static uint8_t frame[BLOCK + 5];
+static size_t frameLength;
+
+void prepForTests(void)
+{
+    terminal.init();
+    shell.attach(terminal);
+    shell.resetBuffer();
+    frameLength = 0;
+    memset(received, 0, sizeof(received));
+    memset(target, 0, sizeof(target));
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// test fixture to ensure clean initial and final conditions
+//
+class BlockTransferTest: public TestOnce {
+    protected:
+        void setup() override {
+            TestOnce::setup();
+            prepForTests();
+        }
+
+        void teardown() override {
+            prepForTests();
+            TestOnce::teardown();
+        }
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// "get" sends source[], "put" receives target[]
+//
+int getCommand(int /*argc*/, char ** /*argv*/, SimpleSerialShell::AsyncState & state)
+{
+    SHELL_ASYNC_BEGIN(state);
+    shell.beginTransfer(transfer, (uintptr_t) source, sizeof(source));
+    SHELL_ASYNC_WAIT_UNTIL(state, (state.locals[0] =
+                                       shell.sendBlocks(transfer, SimpleSerialShell::readRam))
+                           != SimpleSerialShell::PENDING);
+    SHELL_ASYNC_END(state);
+    return state.locals[0];
+}
+
+int putCommand(int /*argc*/, char ** /*argv*/, SimpleSerialShell::AsyncState & state)
+{
+    SHELL_ASYNC_BEGIN(state);
+    shell.beginTransfer(transfer, (uintptr_t) target, sizeof(target));
+    SHELL_ASYNC_WAIT_UNTIL(state, (state.locals[0] =
+                                       shell.receiveBlocks(transfer, SimpleSerialShell::writeRam))
+                           != SimpleSerialShell::PENDING);
+    SHELL_ASYNC_END(state);
+    return state.locals[0];
+}
+
+// "lateget" starts sending on its second call (so a Ctrl-C can come first)
+int lateGetCommand(int /*argc*/, char ** /*argv*/, SimpleSerialShell::AsyncState & state)
+{
+    SHELL_ASYNC_BEGIN(state);
+    SHELL_ASYNC_YIELD(state);
+    shell.beginTransfer(transfer, (uintptr_t) source, sizeof(source));
+    SHELL_ASYNC_WAIT_UNTIL(state, (state.locals[0] =
+                                       shell.sendBlocks(transfer, SimpleSerialShell::readRam))
+                           != SimpleSerialShell::PENDING);
+    SHELL_ASYNC_END(state);
+    return state.locals[0];
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// the host's side
+
+// reads the shell's output until a whole frame is in frame[]
+static bool nextFrame(void)
+{
+    char c;
+    while (terminal.readOutput(&c, 1)) {
+        if (frameLength == 0 && (uint8_t) c != SYNC) {
+            continue;   // (the prompt, say)
+        }
+        frame[frameLength++] = c;
+        if (frameLength >= 3 && frameLength == frame[2] + 5u) {
+            frameLength = 0;
+            return true;
+        }
+    }
+    return false;
+}
+
+// reads the shell's output until a reply; returns its seq, or -1
+static int nextReply(uint8_t reply)
+{
+    char c;
+    while (terminal.readOutput(&c, 1)) {
+        if ((uint8_t) c == reply && terminal.readOutput(&c, 1)) {
+            return (uint8_t) c;
+        }
+    }
+    return -1;
+}
+
+static void sendReply(uint8_t reply, uint8_t seq)
+{
+    terminal.pressKey(reply);
+    terminal.pressKey(seq);
+}
+
+static void sendFrame(uint8_t seq, const uint8_t * data, uint8_t len, bool damaged = false)
+{
+    uint8_t bytes[BLOCK + 5] = { SYNC, seq, len };
+    memcpy(bytes + 3, data, len);
+    uint16_t crc = SimpleSerialShell::crc16(bytes + 1, len + 2);
+    bytes[len + 3] = (crc & 0xff) ^ (damaged ? 1 : 0);
+    bytes[len + 4] = crc >> 8;
+    terminal.pressKeys((const char *) bytes, len + 5);
+}
+
+// runs "get", acknowledging each frame (but NAKs nakFrame once);
+// returns how many frames were sent
+static int hostReceive(int nakFrame, int & mostAtOnce)
+{
+    terminal.pressKeys("get\r");
+    int frames = 0;
+    int expected = 0;
+    mostAtOnce = 0;
+    for (int i = 0; i < 100 && (i == 0 || shell.isBusy()); i++) {
+        shell.executeIfInput();
+        int atOnce = 0;
+        while (nextFrame()) {
+            frames++;
+            atOnce++;
+            uint8_t len = frame[2];
+            uint16_t crc = SimpleSerialShell::crc16(frame + 1, len + 2);
+            if (frame[1] != expected || frame[len + 3] != (crc & 0xff)
+                    || frame[len + 4] != (crc >> 8)) {
+                continue;   // (go-back-N: it will be sent again)
+            }
+            if (expected == nakFrame) {
+                sendReply(NAK, expected);
+                nakFrame = -1;
+                continue;
+            }
+            memcpy(received + expected * BLOCK, frame + 3, len);
+            sendReply(ACK, expected++);
+        }
+        if (atOnce > mostAtOnce) {
+            mostAtOnce = atOnce;
+        }
+    }
+    return frames;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// a window of frames goes out before the first acknowledgement
+testF(BlockTransferTest, sendsFrames)
+{
+    int mostAtOnce;
+    assertEqual(hostReceive(-1, mostAtOnce), (int) (sizeof(source) / BLOCK + 1));
+    assertFalse(shell.isBusy());
+    assertEqual(shell.lastErrNo(), EXIT_SUCCESS);
+    assertEqual(mostAtOnce, SIMPLE_SERIAL_SHELL_BLOCK_WINDOW);
+    assertTrue(memcmp(received, source, sizeof(source)) == 0);
+}
+
+// a NAK has the frames from it on sent again
+testF(BlockTransferTest, resendsAfterNak)
+{
+    int mostAtOnce;
+    assertMore(hostReceive(1, mostAtOnce), (int) (sizeof(source) / BLOCK + 1));
+    assertEqual(shell.lastErrNo(), EXIT_SUCCESS);
+    assertTrue(memcmp(received, source, sizeof(source)) == 0);
+}
+
+// the host can stop a transfer with CAN
+testF(BlockTransferTest, cancelled)
+{
+    terminal.pressKeys("get\r");
+    shell.executeIfInput();
+    assertTrue(shell.isBusy());
+    terminal.pressKey(CAN);
+    shell.executeIfInput();
+    assertFalse(shell.isBusy());
+    assertEqual(shell.lastErrNo(), SimpleSerialShell::CANCELLED);
+}
+
+// a transfer stopped by Ctrl-C doesn't leave the shell deaf to the next one
+testF(BlockTransferTest, ctrlCBeforeTransfer)
+{
+    for (int i = 0; i < 2; i++) {
+        assertEqual(shell.execute("lateget"), SimpleSerialShell::PENDING);
+        terminal.pressKey(0x03);
+        shell.executeIfInput();
+        assertFalse(shell.isBusy());
+        assertEqual(shell.lastErrNo(), SimpleSerialShell::CANCELLED);
+        terminal.discardOutput();
+    }
+}
+
+// damaged frames are NAKed (once), repeated ones ACKed again, and
+// Ctrl-C is just data
+testF(BlockTransferTest, receivesFrames)
+{
+    uint8_t data[sizeof(target)];
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = i * 3;    // (includes Ctrl-C and CAN)
+    }
+
+    terminal.pressKeys("put\r");
+    shell.executeIfInput();
+    assertTrue(shell.isBusy());
+    assertEqual(nextReply(NAK), 0);    // ready
+
+    sendFrame(0, data, BLOCK);
+    sendFrame(1, data + BLOCK, BLOCK, true);
+    sendFrame(2, data, 0);              // (in flight; ignored)
+    shell.executeIfInput();
+    assertEqual(nextReply(ACK), 0);
+    assertEqual(nextReply(NAK), 1);
+    assertEqual(nextReply(NAK), -1);
+
+    sendFrame(0, data, BLOCK);          // its ACK was "lost"
+    sendFrame(1, data + BLOCK, BLOCK);
+    sendFrame(2, data, 0);              // the end
+    shell.executeIfInput();
+    assertEqual(nextReply(ACK), 0);
+    assertEqual(nextReply(ACK), 1);
+    assertEqual(nextReply(ACK), 2);
+    assertFalse(shell.isBusy());
+    assertEqual(shell.lastErrNo(), EXIT_SUCCESS);
+    assertTrue(memcmp(target, data, sizeof(target)) == 0);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+int showID(int /*argc*/ = 0, char ** /*argv*/ = NULL)
+{
+    Serial.println();
+    Serial.println(F( "Running " __FILE__ ", Built " __DATE__));
+    return 0;
+};
+
+//////////////////////////////////////////////////////////////////////////////
+void setup() {
+    ::delay(1000); // wait for stability on some boards to prevent garbage Serial
+    Serial.begin(115200); // ESP8266 default of 74880 not supported on Linux
+    while (!Serial); // for the Arduino Leonardo/Micro only
+    showID();
+
+    for (size_t i = 0; i < sizeof(source); i++) {
+        source[i] = 255 - i;
+    }
+    shell.addAsyncCommand(F("get"), getCommand);
+    shell.addAsyncCommand(F("put"), putCommand);
+    shell.addAsyncCommand(F("lateget"), lateGetCommand);
+    shell.attach(terminal);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+void loop() {
+    // Should get:
+    // TestRunner summary:
+    //   <n> passed, <n> failed, <n> skipped, <n> timed out, out of <n> test(s).
+    aunit::TestRunner::run();
+}
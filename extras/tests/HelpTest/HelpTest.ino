@@ -59,6 +59,28 @@ int rangeCommand(int, char **)
     return 0;
 }
 
+// Compressed documentation, as extras/tools/compressHelp.py would generate
+// (0x80 and 0x81 refer to the first and second dictionary entries).
+
+static const char helpDictionary[] PROGMEM = "\x05lower" "\x05upper";
+#define limitsCommandNameAndDocs F("limits <\x80> <\x81>")
+
+// ... registered only for the tests that use it
+class HelpCompressedTest: public HelpTest {
+    protected:
+        void setup() override {
+            HelpTest::setup();
+            shell.addCommand(limitsCommandNameAndDocs, rangeCommand);
+            shell.setHelpDictionary((const __FlashStringHelper *) helpDictionary);
+        }
+
+        void teardown() override {
+            shell.setHelpDictionary(NULL);
+            shell.removeCommand("limits");
+            HelpTest::teardown();
+        }
+};
+
 //////////////////////////////////////////////////////////////////////////////
 // The goal of this test is to validate that the help messages
 // return as expected.
@@ -122,6 +144,41 @@ testF(HelpTest, helpTest2)
         COMMAND_PROMPT));
 }
 
+//////////////////////////////////////////////////////////////////////////////
+// "help <prefix>" lists only the matching commands
+testF(HelpTest, helpPrefix)
+{
+    terminal.pressKeys("help RA\r");
+    assertTrue(shell.executeIfInput());
+    assertEqual(terminal.getline(),
+        ("help RA" NEW_LINE
+        HELP_PREAMBLE NEW_LINE
+        TWO_SPACE "range <lower> <upper>" COMMAND_PROMPT));
+
+    terminal.pressKeys("help x\r");
+    assertTrue(shell.executeIfInput());
+    assertEqual(terminal.getline(),
+        ("help x" NEW_LINE
+        HELP_PREAMBLE COMMAND_PROMPT));
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// compressed documentation is expanded as it is printed
+testF(HelpCompressedTest, helpCompressed)
+{
+    terminal.pressKeys("help li\r");
+    assertTrue(shell.executeIfInput());
+    assertEqual(terminal.getline(),
+        ("help li" NEW_LINE
+        HELP_PREAMBLE NEW_LINE
+        TWO_SPACE "limits <lower> <upper>" COMMAND_PROMPT));
+
+    // a compressed command name still matches as typed
+    terminal.pressKeys("limits 1 2\r");
+    assertTrue(shell.executeIfInput());
+    assertEqual(terminal.getline(), ("limits 1 2" COMMAND_PROMPT));
+}
+
 //////////////////////////////////////////////////////////////////////////////
 // ... so which sketch is this?
 int showID(int /*argc*/ = 0, char ** /*argv*/ = NULL)
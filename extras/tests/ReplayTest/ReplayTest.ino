@@ -0,0 +1,294 @@
+// ReplayTest.ino
+//
+// Record a console session, then replay it through the shell.
+//
+#include <Arduino.h>
+
+// fake it for UnixHostDuino emulation
+#if defined(UNIX_HOST_DUINO)
+#  ifndef ARDUINO
+#  define ARDUINO 100
+#  endif
+#endif
+
+// These tests depend on the Arduino "AUnit" library
+#include <AUnit.h>
+#include "BulkStream.h"
+#include <SimpleSerialShell.h>
+#include <SessionRecorder.h>
+
+using namespace aunit;
+
+static BulkStream terminal(0x1000, 0x1000);
+static BulkStream logFile(0x1000, 0x1000);   // written as output, replayed as input
+
+void prepForTests(void)
+{
+    terminal.init();
+    logFile.init();
+    shell.attach(terminal);
+    shell.resetBuffer();
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// test fixture to ensure clean initial and final conditions
+//
+class ReplayTest: public TestOnce {
+    protected:
+        void setup() override {
+            TestOnce::setup();
+            prepForTests();
+        }
+
+        void teardown() override {
+            prepForTests();
+            TestOnce::teardown();
+        }
+};
+
+//////////////////////////////////////////////////////////////////////////////
+int echo(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++) {
+        shell.print(argv[i]);
+        shell.print(i < argc - 1 ? F(" ") : F(""));
+    }
+    shell.println();
+    return EXIT_SUCCESS;
+}
+
+int sum(int argc, char **argv)
+{
+    int aSum = 0;
+    for (int i = 1; i < argc; i++) {
+        aSum += atoi(argv[i]);
+    }
+    shell.println(aSum);
+    return aSum;
+}
+
+// "lines" prints more than a few records' worth
+static int lineCount = 30;
+
+int lines(int /*argc*/, char ** /*argv*/)
+{
+    for (int i = 0; i < lineCount; i++) {
+        shell.println(F("0123456789"));
+    }
+    return EXIT_SUCCESS;
+}
+
+// "hang" waits for released
+static bool released = true;
+
+int hang(int /*argc*/, char ** /*argv*/, SimpleSerialShell::AsyncState & state)
+{
+    SHELL_ASYNC_BEGIN(state);
+    SHELL_ASYNC_WAIT_UNTIL(state, released);
+    SHELL_ASYNC_END(state);
+    return EXIT_SUCCESS;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// run a short session through a recorder; returns the size of the log
+static const char * const helloSession[] = {
+    "echo hello world\rsum 1 2 3\r", "nosuchcommand\r", NULL
+};
+
+static size_t recordSession(char * logBuffer, size_t len,
+                            const char * const * session = helloSession,
+                            unsigned long pause = 0)
+{
+    ShellRecorder recorder(terminal, logFile);
+    recorder.begin();
+    shell.attach(recorder);
+
+    for ( ; *session; session++) {
+        ::delay(pause);
+        terminal.pressKeys(*session);
+        while (shell.executeIfInput()) {
+        }
+    }
+    recorder.flush();
+
+    shell.attach(terminal);
+    return logFile.readOutput(logBuffer, len);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// a faithful replay finds no differences
+testF(ReplayTest, replayMatches)
+{
+    char log[512];
+    size_t logLength = recordSession(log, sizeof(log));
+    assertTrue(logLength > 4);
+    assertTrue(memcmp(log, "SSR1", 4) == 0);
+
+    BulkStream replayLog(0x1000, 0x10);
+    replayLog.pressKeys(log, logLength);
+
+    ShellReplayer replayer(shell, replayLog);
+    assertEqual(replayer.run(), 0);
+    assertEqual(replayer.inputBytes(),
+                (unsigned long) strlen("echo hello world\rsum 1 2 3\rnosuchcommand\r"));
+    assertEqual(replayer.outputBytes(), terminal.bytesOut());
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// a replay at recorded timing matches too
+testF(ReplayTest, replayRecordedTiming)
+{
+    char log[512];
+    size_t logLength = recordSession(log, sizeof(log));
+
+    BulkStream replayLog(0x1000, 0x10);
+    replayLog.pressKeys(log, logLength);
+
+    ShellReplayer replayer(shell, replayLog);
+    assertEqual(replayer.run(true), 0);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// changed behavior is reported
+testF(ReplayTest, replayFindsDifferences)
+{
+    char log[512];
+    size_t logLength = recordSession(log, sizeof(log));
+
+    // "hello world" was printed; pretend it was "jello world"
+    char * hello = NULL;
+    for (size_t i = 0; i + 5 < logLength; i++) {
+        if (memcmp(log + i, "hello", 5) == 0) {
+            hello = log + i;    // the last one is the output, not the echo
+        }
+    }
+    assertTrue(hello != NULL);
+    *hello = 'j';
+
+    BulkStream replayLog(0x1000, 0x10);
+    replayLog.pressKeys(log, logLength);
+    BulkStream reportStream(0x10, 0x400);
+
+    ShellReplayer replayer(shell, replayLog);
+    replayer.setReport(reportStream);
+    assertEqual(replayer.run(), 1);
+    assertTrue(reportStream.outputCount() > 0);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// output is compared as it arrives, however much a command prints
+testF(ReplayTest, replayLongOutput)
+{
+    static const char * const session[] = { "lines\recho done\r", NULL };
+    char log[1024];
+    size_t logLength = recordSession(log, sizeof(log), session);
+    assertTrue(terminal.bytesOut() > 300);
+
+    BulkStream replayLog(0x1000, 0x10);
+    replayLog.pressKeys(log, logLength);
+
+    ShellReplayer replayer(shell, replayLog);
+    assertEqual(replayer.run(), 0);
+    assertEqual(replayer.outputBytes(), terminal.bytesOut());
+}
+
+// at recorded timing, input isn't read ahead of its time (even when the
+// output differs)
+testF(ReplayTest, replayKeepsInputTiming)
+{
+    static const char * const session[] = { "lines\r", "echo done\r", NULL };
+    char log[1024];
+    size_t logLength = recordSession(log, sizeof(log), session, 30);
+
+    BulkStream replayLog(0x1000, 0x10);
+    replayLog.pressKeys(log, logLength);
+
+    lineCount = 31;
+    ShellReplayer replayer(shell, replayLog);
+    unsigned long start = millis();
+    assertMore(replayer.run(true), 0);
+    assertMoreOrEqual(millis() - start, 50UL);
+    lineCount = 30;
+}
+
+// input the shell never reads is given up on
+testF(ReplayTest, replayStalled)
+{
+    static const char * const session[] = { "hang\recho hi\r", NULL };
+    char log[512];
+    size_t logLength = recordSession(log, sizeof(log), session);
+
+    BulkStream replayLog(0x1000, 0x10);
+    replayLog.pressKeys(log, logLength);
+
+    released = false;
+    ShellReplayer replayer(shell, replayLog);
+    assertMore(replayer.run(), 0);
+    assertTrue(shell.isBusy());
+
+    released = true;
+    while (shell.isBusy()) {
+        shell.executeIfInput();
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// an output queue drains through the recorder and the replayer
+testF(ReplayTest, replayOutputQueue)
+{
+    static uint8_t queue[64];
+    shell.setOutputQueue(queue, sizeof(queue));
+    char log[512];
+    size_t logLength = recordSession(log, sizeof(log));
+    assertTrue(terminal.bytesOut() > 0);
+
+    BulkStream replayLog(0x1000, 0x10);
+    replayLog.pressKeys(log, logLength);
+
+    ShellReplayer replayer(shell, replayLog);
+    assertEqual(replayer.run(), 0);
+    assertEqual(replayer.outputBytes(), terminal.bytesOut());
+    shell.setOutputQueue(NULL, 0);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// not a session log
+testF(ReplayTest, replayRejectsBadLog)
+{
+    BulkStream replayLog(0x100, 0x10);
+    replayLog.pressKeys("echo hi\r");
+
+    ShellReplayer replayer(shell, replayLog);
+    assertEqual(replayer.run(), -1);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// ... so which sketch is this?
+int showID(int /*argc*/ = 0, char ** /*argv*/ = NULL)
+{
+    Serial.println();
+    Serial.println(F( "Running " __FILE__ ", Built " __DATE__));
+    return 0;
+};
+
+//////////////////////////////////////////////////////////////////////////////
+void setup() {
+    ::delay(1000); // wait for stability on some boards to prevent garbage Serial
+    Serial.begin(115200); // ESP8266 default of 74880 not supported on Linux
+    while (!Serial); // for the Arduino Leonardo/Micro only
+    showID();
+
+    shell.addCommand(F("echo"), echo);
+    shell.addCommand(F("sum"), sum);
+    shell.addCommand(F("lines"), lines);
+    shell.addAsyncCommand(F("hang"), hang);
+    shell.attach(terminal);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+void loop() {
+    // Should get:
+    // TestRunner summary:
+    //   <n> passed, <n> failed, <n> skipped, <n> timed out, out of <n> test(s).
+    aunit::TestRunner::run();
+}
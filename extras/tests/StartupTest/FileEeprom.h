@@ -0,0 +1,79 @@
+#ifndef _FileEeprom_h
+#define _FileEeprom_h
+
+#include <stdio.h>
+#include <StartupScript.h>
+
+/**
+ * @brief A file-backed stand-in for EEPROM, for host (EpoxyDuino) builds.
+ *
+ * The contents survive "reboots" (constructing another FileEeprom on the
+ * same file).  A new file starts out erased (0xFF), like a new part.
+ * Writes counts bytes actually changed, to keep an eye on wear.
+ *
+ * A header-only class for ease of re-use across tests cases.
+ */
+class FileEeprom : public ShellStorage {
+    public:
+        FileEeprom(const char * path, size_t size)
+            : _size(size), _writes(0)
+        {
+            _file = fopen(path, "r+b");
+            if (!_file) {
+                _file = fopen(path, "w+b");
+                for (size_t i = 0; i < size; i++) {
+                    fputc(0xFF, _file);
+                }
+                fflush(_file);
+            }
+        }
+
+        ~FileEeprom()
+        {
+            if (_file) {
+                fclose(_file);
+            }
+        }
+
+        unsigned long writes() const
+        {
+            return _writes;
+        }
+
+        // ------------------------------------------------------------------------
+        // Implementation of the ShellStorage interface.
+
+        virtual size_t length()
+        {
+            return _file ? _size : 0;
+        }
+
+        virtual uint8_t read(size_t address)
+        {
+            fseek(_file, address, SEEK_SET);
+            int c = fgetc(_file);
+            return c < 0 ? 0xFF : c;
+        }
+
+        // like EEPROM.update(): only changed bytes are written
+        virtual void write(size_t address, uint8_t value)
+        {
+            if (read(address) != value) {
+                fseek(_file, address, SEEK_SET);
+                fputc(value, _file);
+                _writes++;
+            }
+        }
+
+        virtual void commit()
+        {
+            fflush(_file);
+        }
+
+    private:
+        FILE * _file;
+        size_t _size;
+        unsigned long _writes;
+};
+
+#endif
@@ -0,0 +1,198 @@
+// StartupTest.ino
+//
+// Save command lines to (simulated) EEPROM, and replay them after a "reboot".
+//
+#include <Arduino.h>
+
+// fake it for UnixHostDuino emulation
+#if defined(UNIX_HOST_DUINO)
+#  ifndef ARDUINO
+#  define ARDUINO 100
+#  endif
+#endif
+
+// These tests depend on the Arduino "AUnit" library
+#include <AUnit.h>
+#include "SimulatedStream.h"
+#include "FileEeprom.h"
+#include <SimpleSerialShell.h>
+#include <StartupScript.h>
+
+#define NEW_LINE "\r\n"
+#define EEPROM_FILE "/tmp/StartupTest.eeprom"
+
+static int level = 0;   // set by "setlevel"
+
+// A mock of the Arduino Serial stream
+static SimulatedStream<128> terminal;
+
+static FileEeprom eeprom(EEPROM_FILE, 64);
+static StartupScript startup(eeprom, 16);   // leave room for other settings
+
+//////////////////////////////////////////////////////////////////////////////
+// test fixture: each test starts with erased EEPROM
+//
+class StartupTest: public aunit::TestOnce {
+    protected:
+        void setup() override {
+            TestOnce::setup();
+            for (size_t i = 0; i < eeprom.length(); i++) {
+                eeprom.write(i, 0xFF);
+            }
+            eeprom.commit();
+            level = 0;
+            shell.resetBuffer();
+            terminal.init();
+        }
+
+        void teardown() override {
+            shell.resetBuffer();
+            TestOnce::teardown();
+        }
+};
+
+int setLevel(int argc, char **argv)
+{
+    level = (argc > 1) ? atoi(argv[1]) : 0;
+    return EXIT_SUCCESS;
+}
+
+int fail(int, char **)
+{
+    return 1;
+}
+
+// "countup <n>" raises level by one on each call, up to n
+int countUp(int argc, char **argv, SimpleSerialShell::AsyncState & state)
+{
+    SHELL_ASYNC_BEGIN(state);
+    while (level < ((argc > 1) ? atoi(argv[1]) : 0)) {
+        level++;
+        SHELL_ASYNC_YIELD(state);
+    }
+    SHELL_ASYNC_END(state);
+    return EXIT_SUCCESS;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// lines saved in one session run in the next
+testF(StartupTest, persistAndReplay)
+{
+    assertFalse(startup.isValid());
+    assertEqual(startup.run(shell), -1);   // (erased EEPROM)
+
+    assertEqual(shell.execute("startup add setlevel 5"), 0);
+    assertEqual(shell.execute("startup add setlevel   7"), 0);
+    assertEqual(shell.execute("startup list"), 0);
+    assertEqual(terminal.getline(), "setlevel 5" NEW_LINE "setlevel 7" NEW_LINE);
+    assertEqual(level, 0);
+
+    // "reboot"
+    FileEeprom rebooted(EEPROM_FILE, 64);
+    StartupScript script(rebooted, 16);
+    assertTrue(script.isValid());
+    assertEqual(script.run(shell), 0);
+    assertEqual(level, 7);
+    for (size_t i = 0; i < 16; i++) {
+        assertEqual(rebooted.read(i), 0xFF);     // the rest is untouched
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// failed lines are counted; "startup clear" empties the script
+testF(StartupTest, failuresAndClear)
+{
+    assertTrue(startup.append("fail"));
+    assertTrue(startup.append("setlevel 3"));
+    assertTrue(startup.append("nosuchcommand"));
+    assertEqual(shell.execute("startup run"), 2);
+    assertEqual(level, 3);
+    assertEqual(terminal.getline(), "\"nosuchcommand\": -1: command not found" NEW_LINE);
+
+    // a script that runs itself doesn't recurse
+    assertTrue(startup.append("startup run"));
+    assertEqual(startup.run(shell), 3);
+    terminal.init();
+
+    assertEqual(shell.execute("startup clear"), 0);
+    assertTrue(startup.isValid());
+    assertEqual(startup.run(shell), 0);
+    assertEqual(shell.execute("startup"), 0);
+    assertEqual(terminal.getline(), "");
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// an asynchronous line finishes before the next, without prompting or
+// taking input
+testF(StartupTest, asyncLine)
+{
+    assertTrue(startup.append("countup 3"));
+    assertTrue(startup.append("setlevel 5"));
+    terminal.pressKeys("setlevel 9\r");
+    assertEqual(startup.run(shell), 0);
+    assertEqual(level, 5);
+    assertFalse(shell.isBusy());
+    assertEqual(terminal.getOutput(), "");
+
+    // the typed line is still there for the shell to run
+    while (shell.executeIfInput()) {
+    }
+    assertEqual(level, 9);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// a damaged script is not run, and storage is bounded
+testF(StartupTest, checksumAndFull)
+{
+    assertTrue(startup.append("setlevel 9"));
+    level = 0;
+    eeprom.write(16 + 6 + 9, '8');    // "setlevel 8"
+    assertFalse(startup.isValid());
+    assertEqual(startup.run(shell), -1);
+    assertEqual(level, 0);
+
+    startup.clear();
+    // 64 - 16 - 6 = 42 bytes of text
+    assertTrue(startup.append("setlevel 1111111111111111111111111111111"));
+    assertFalse(startup.append("setlevel 2"));
+    assertEqual(shell.execute("startup add setlevel 2"), -1);
+    assertEqual(terminal.getline(), "startup: storage full" NEW_LINE);
+
+    // a line that wouldn't fit the shell's buffer isn't cut short
+    startup.clear();
+    char longArg[SIMPLE_SERIAL_SHELL_BUFSIZE];
+    memset(longArg, '1', sizeof(longArg) - 1);
+    longArg[sizeof(longArg) - 1] = '\0';
+    char * argv[] = { (char *) "startup", (char *) "add", (char *) "setlevel", longArg };
+    assertEqual(shell.execute(4, argv), -1);
+    assertEqual(terminal.getline(), "startup: line too long" NEW_LINE);
+    assertEqual(startup.run(shell), 0);
+    assertEqual(level, 0);
+
+    // unchanged bytes are not rewritten
+    startup.clear();
+    unsigned long writes = eeprom.writes();
+    startup.clear();
+    assertEqual(eeprom.writes(), writes);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+void setup() {
+    ::delay(1000); // wait for stability on some boards to prevent garbage Serial
+    Serial.begin(115200); // ESP8266 default of 74880 not supported on Linux
+    while (!Serial); // for the Arduino Leonardo/Micro only
+
+    shell.attach(terminal);
+    shell.addCommand(F("setlevel <n>"), setLevel);
+    shell.addCommand(F("fail"), fail);
+    shell.addAsyncCommand(F("countup <n>"), countUp);
+    startup.addCommands(shell);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+void loop() {
+    // Should get:
+    // TestRunner summary:
+    //   <n> passed, <n> failed, <n> skipped, <n> timed out, out of <n> test(s).
+    aunit::TestRunner::run();
+}
@@ -0,0 +1,316 @@
+#ifndef _BulkStream_h
+#define _BulkStream_h
+
+#include <Arduino.h>
+
+/**
+ * @brief A high-capacity Stream for stress testing and benchmarking the shell.
+ *
+ * Unlike SimulatedStream (which is built on SimpleFIFO with 8-bit indices
+ * and per-element volatile access) this stream keeps its input and output
+ * in plain byte rings of any size, and moves data in bulk with memcpy().
+ *
+ * - pressKeys(buf, len) queues "typed" input in one step.
+ * - write(buf, len) / readBytes() move whole blocks.
+ * - readOutput() drains captured output into a caller buffer, so tests
+ *   never build a String one character at a time.
+ * - setBaudRate() optionally limits how fast input becomes available,
+ *   to emulate a real serial line.  By default there is no limit, so soak
+ *   tests can replay hours of traffic in seconds.
+ *
+ * A header-only class for ease of re-use across tests cases.
+ */
+class BulkStream : public Stream {
+    public:
+
+        BulkStream(size_t inputCapacity, size_t outputCapacity)
+            : _input(inputCapacity), _output(outputCapacity)
+        {
+            init();
+        }
+
+        void init()
+        {
+            _input.clear();
+            _output.clear();
+            _bytesIn = _bytesOut = _bytesDropped = 0;
+            _blockedWrites = 0;
+            setBaudRate(0);
+            setWriteRoom(-1);
+        }
+
+        /**
+         * @brief Limits input delivery to roughly (baud / 10) bytes per
+         * second (8N1 framing).  Zero removes the limit.
+         */
+        void setBaudRate(unsigned long baud)
+        {
+            _bytesPerSecond = baud / 10;
+            _credit = 0;
+            _lastCreditMicros = micros();
+        }
+
+        /**
+         * @brief Emulates a UART transmit buffer with only `room` bytes
+         * free.  Writes beyond that are still accepted, but are counted as
+         * writes that would have blocked.  A negative room removes the limit.
+         */
+        void setWriteRoom(long room)
+        {
+            _writeRoom = room;
+        }
+
+        unsigned long blockedWrites() const
+        {
+            return _blockedWrites;
+        }
+
+        /**
+         * @brief Simulates the entry of a block of inbound characters.
+         *
+         * @return the number of characters accepted (input may be full).
+         */
+        size_t pressKeys(const char * keys, size_t len)
+        {
+            return _input.put((const uint8_t *) keys, len);
+        }
+
+        size_t pressKeys(const char * keys)
+        {
+            return pressKeys(keys, strlen(keys));
+        }
+
+        size_t pressKey(char key)
+        {
+            return pressKeys(&key, 1);
+        }
+
+        // room left for more simulated keypresses
+        size_t inputSpace() const
+        {
+            return _input.space();
+        }
+
+        /**
+         * @brief Copies (and removes) up to len bytes of captured output.
+         *
+         * @return number of bytes copied.
+         */
+        size_t readOutput(char * buffer, size_t len)
+        {
+            return _output.get((uint8_t *) buffer, len);
+        }
+
+        // Returns the captured output as a NUL-terminated string
+        // (truncated to fit), then flushes.
+        const char * getline(char * buffer, size_t len)
+        {
+            size_t n = readOutput(buffer, len - 1);
+            buffer[n] = '\0';
+            discardOutput();
+            return buffer;
+        }
+
+        size_t outputCount() const
+        {
+            return _output.count();
+        }
+
+        void discardOutput()
+        {
+            _output.clear();
+        }
+
+        // running totals since init()
+        unsigned long bytesIn() const
+        {
+            return _bytesIn;
+        }
+        unsigned long bytesOut() const
+        {
+            return _bytesOut;
+        }
+        unsigned long bytesDropped() const
+        {
+            return _bytesDropped;
+        }
+
+        // ------------------------------------------------------------------------
+        // Implementation of the Stream interface.
+
+        virtual size_t write(uint8_t c)
+        {
+            return write(&c, 1);
+        }
+
+        virtual size_t write(const uint8_t * buffer, size_t size)
+        {
+            if (_writeRoom >= 0) {
+                if ((long) size > _writeRoom) {
+                    _blockedWrites++;
+                    _writeRoom = 0;
+                } else {
+                    _writeRoom -= size;
+                }
+            }
+            size_t n = _output.put(buffer, size);
+            _bytesOut += n;
+            _bytesDropped += size - n;
+            return n;
+        }
+
+        virtual int availableForWrite()
+        {
+            if (_writeRoom >= 0 && (size_t) _writeRoom < _output.space()) {
+                return (int) _writeRoom;
+            }
+            return (int) _output.space();
+        }
+
+        virtual int available()
+        {
+            size_t n = _input.count();
+            if (_bytesPerSecond) {
+                updateCredit();
+                if (n > _credit) {
+                    n = _credit;
+                }
+            }
+            return (int) n;
+        }
+
+        virtual int read()
+        {
+            uint8_t c;
+            return readBytes((char *) &c, 1) ? c : -1;
+        }
+
+        virtual int peek()
+        {
+            return available() ? _input.peek() : -1;
+        }
+
+        virtual size_t readBytes(char * buffer, size_t length)
+        {
+            size_t limit = (size_t) available();
+            if (length > limit) {
+                length = limit;
+            }
+            size_t n = _input.get((uint8_t *) buffer, length);
+            if (_bytesPerSecond) {
+                _credit -= n;
+            }
+            _bytesIn += n;
+            return n;
+        }
+
+        virtual void flush()
+        {
+        }
+
+    private:
+
+        // a plain byte ring with bulk (two segment) copies
+        class Ring {
+            public:
+                explicit Ring(size_t capacity)
+                    : _buf(new uint8_t[capacity]), _capacity(capacity)
+                {
+                    clear();
+                }
+                ~Ring()
+                {
+                    delete [] _buf;
+                }
+
+                void clear()
+                {
+                    _head = _tail = _count = 0;
+                }
+                size_t count() const
+                {
+                    return _count;
+                }
+                size_t space() const
+                {
+                    return _capacity - _count;
+                }
+                uint8_t peek() const
+                {
+                    return _buf[_tail];
+                }
+
+                size_t put(const uint8_t * src, size_t len)
+                {
+                    if (len > space()) {
+                        len = space();
+                    }
+                    size_t first = _capacity - _head;
+                    if (first > len) {
+                        first = len;
+                    }
+                    memcpy(_buf + _head, src, first);
+                    memcpy(_buf, src + first, len - first);
+                    _head = (_head + len) % _capacity;
+                    _count += len;
+                    return len;
+                }
+
+                size_t get(uint8_t * dst, size_t len)
+                {
+                    if (len > _count) {
+                        len = _count;
+                    }
+                    size_t first = _capacity - _tail;
+                    if (first > len) {
+                        first = len;
+                    }
+                    memcpy(dst, _buf + _tail, first);
+                    memcpy(dst + first, _buf, len - first);
+                    _tail = (_tail + len) % _capacity;
+                    _count -= len;
+                    return len;
+                }
+
+            private:
+                Ring(const Ring &);
+                Ring & operator=(const Ring &);
+
+                uint8_t * const _buf;
+                const size_t _capacity;
+                size_t _head;
+                size_t _tail;
+                size_t _count;
+        };
+
+        void updateCredit()
+        {
+            unsigned long now = micros();
+            unsigned long elapsed = now - _lastCreditMicros;
+            size_t earned = (size_t)((unsigned long long) elapsed
+                                     * _bytesPerSecond / 1000000UL);
+            if (earned > 0) {
+                _credit += earned;
+                _lastCreditMicros = now;
+            }
+            // an idle line does not bank time for characters not yet typed
+            if (_credit > _input.count()) {
+                _credit = _input.count();
+            }
+        }
+
+        Ring _input;
+        Ring _output;
+
+        unsigned long _bytesIn;
+        unsigned long _bytesOut;
+        unsigned long _bytesDropped;
+        unsigned long _blockedWrites;
+        long _writeRoom;
+
+        unsigned long _bytesPerSecond;
+        size_t _credit;
+        unsigned long _lastCreditMicros;
+};
+
+#endif
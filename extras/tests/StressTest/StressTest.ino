@@ -0,0 +1,432 @@
+// StressTest.ino
+//
+// Push large volumes of traffic through the shell, using a bulk-capable
+// simulated stream (host builds only; it needs far more RAM than an Arduino).
+//
+#include <Arduino.h>
+
+// fake it for UnixHostDuino emulation
+#if defined(UNIX_HOST_DUINO)
+#  ifndef ARDUINO
+#  define ARDUINO 100
+#  endif
+#endif
+
+// These tests depend on the Arduino "AUnit" library
+#include <AUnit.h>
+#include "BulkStream.h"
+#include <SimpleSerialShell.h>
+
+using namespace aunit;
+
+#define NEW_LINE "\r\n"
+#define COMMAND_PROMPT NEW_LINE "> "
+
+// 64 KB of "keyboard" and 256 KB of "display"
+static BulkStream terminal(0x10000, 0x40000);
+
+void prepForTests(void)
+{
+    shell.setOutputQueue(NULL, 0);
+    terminal.init();
+    shell.resetBuffer();
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// test fixture to ensure clean initial and final conditions
+//
+class StressTest: public TestOnce {
+    protected:
+        void setup() override {
+            TestOnce::setup();
+            prepForTests();
+        }
+
+        void teardown() override {
+            prepForTests();
+            TestOnce::teardown();
+        }
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// a command that just counts how often (and with what) it was called
+static unsigned long tallyCalls = 0;
+static unsigned long tallyTotal = 0;
+
+int tally(int argc, char **argv)
+{
+    tallyCalls++;
+    if (argc > 1) {
+        tallyTotal += strtoul(argv[1], NULL, 10);
+    }
+    return EXIT_SUCCESS;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// bulk writes and reads move whole blocks, and wrap around the ring
+testF(StressTest, bulkTransfer)
+{
+    BulkStream small(16, 16);
+    char block[12];
+    char result[16];
+
+    for (int round = 0; round < 10; round++) {
+        for (size_t i = 0; i < sizeof(block); i++) {
+            block[i] = 'a' + (round + i) % 26;
+        }
+        assertEqual(small.write((const uint8_t *) block, sizeof(block)),
+                    sizeof(block));
+        assertEqual(small.readOutput(result, sizeof(result)), sizeof(block));
+        assertTrue(memcmp(block, result, sizeof(block)) == 0);
+
+        assertEqual(small.pressKeys(block, sizeof(block)), sizeof(block));
+        assertEqual(small.available(), (int) sizeof(block));
+        assertEqual(small.readBytes(result, sizeof(result)), sizeof(block));
+        assertTrue(memcmp(block, result, sizeof(block)) == 0);
+    }
+
+    // a full output ring drops (and counts) the excess
+    assertEqual(small.write((const uint8_t *) block, sizeof(block)),
+                sizeof(block));
+    assertEqual(small.write((const uint8_t *) block, sizeof(block)),
+                (size_t) 4);
+    assertEqual(small.bytesDropped(), 8UL);
+    assertEqual(small.availableForWrite(), 0);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// output is captured without building a String per character
+testF(StressTest, captureOutput)
+{
+    terminal.pressKeys("tally 7\r");
+    assertTrue(shell.executeIfInput());
+
+    char aLine[32];
+    assertEqual(terminal.getline(aLine, sizeof(aLine)),
+                "tally 7" COMMAND_PROMPT);
+    assertEqual(terminal.outputCount(), (size_t) 0);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// push a few megabytes of commands through the shell
+testF(StressTest, soak)
+{
+    const unsigned long bytesToSend = 4UL * 1024 * 1024;
+    char aLine[24];
+    unsigned long sent = 0;
+    unsigned long lines = 0;
+    unsigned long expectedTotal = 0;
+    unsigned long outputSeen = 0;
+
+    tallyCalls = tallyTotal = 0;
+
+    while (sent < bytesToSend) {
+        // refill the "keyboard" in big blocks
+        while (terminal.inputSpace() >= sizeof(aLine)) {
+            unsigned long n = lines % 1000;
+            int len = snprintf(aLine, sizeof(aLine), "tally %lu\r", n);
+            terminal.pressKeys(aLine, len);
+            sent += len;
+            expectedTotal += n;
+            lines++;
+        }
+
+        while (shell.executeIfInput()) {
+            // run everything that is queued
+        }
+
+        outputSeen += terminal.outputCount();
+        terminal.discardOutput();
+    }
+
+    assertEqual(tallyCalls, lines);
+    assertEqual(tallyTotal, expectedTotal);
+    assertEqual(terminal.bytesIn(), sent);
+    assertEqual(terminal.bytesDropped(), 0UL);
+
+    // each line is echoed, then followed by a newline and a prompt
+    assertEqual(outputSeen, sent - lines + lines * strlen(COMMAND_PROMPT));
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// a baud rate limits how quickly input arrives
+testF(StressTest, rateLimit)
+{
+    terminal.setBaudRate(9600);     // about 960 characters/second
+    terminal.pressKeys("tally 1\rtally 2\rtally 3\rtally 4\r");
+
+    assertLess(terminal.available(), 8);
+
+    ::delay(20);     // ~19 characters worth of line time
+    int ready = terminal.available();
+    assertMore(ready, 0);
+    assertLess(ready, 32);
+
+    terminal.setBaudRate(0);
+    assertEqual(terminal.available(), 32);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// a command that prints a lot
+int chatter(int argc, char **argv)
+{
+    int lines = (argc > 1) ? atoi(argv[1]) : 10;
+    for (int i = 0; i < lines; i++) {
+        shell.println(F("0123456789abcdefghijklmnopqrstuvwxyz"));  // 38 bytes
+    }
+    return EXIT_SUCCESS;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// with an output queue, a full transmit buffer does not block the shell
+testF(StressTest, outputQueue)
+{
+    static uint8_t queue[512];
+    shell.setOutputQueue(queue, sizeof(queue));
+
+    terminal.setWriteRoom(16);  // "UART" only has room for 16 bytes
+    assertEqual(shell.execute("chatter 10"), 0);
+    assertEqual(terminal.blockedWrites(), 0UL);
+    assertEqual(terminal.outputCount(), (size_t) 16);
+    assertEqual(shell.outputQueued(), (size_t) (380 - 16));
+
+    // drains a little more on each pass through executeIfInput()
+    terminal.setWriteRoom(100);
+    shell.executeIfInput();
+    assertEqual(shell.outputQueued(), (size_t) (380 - 116));
+    assertEqual(terminal.blockedWrites(), 0UL);
+
+    terminal.setWriteRoom(-1);
+    shell.executeIfInput();
+    assertEqual(shell.outputQueued(), (size_t) 0);
+    assertEqual(terminal.outputCount(), (size_t) 380);
+    assertEqual(shell.outputDropped(), 0UL);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// overflowing the queue drops (and counts) output, and stalls are timed
+testF(StressTest, outputQueueOverflow)
+{
+    static uint8_t queue[64];
+    shell.setOutputQueue(queue, sizeof(queue));
+
+    terminal.setWriteRoom(0);
+    assertEqual(shell.execute("chatter 2"), 0);
+    assertEqual(shell.outputQueued(), (size_t) 64);
+    assertEqual(shell.outputDropped(), (unsigned long) (76 - 64));
+
+    ::delay(10);
+    shell.executeIfInput();
+    assertMoreOrEqual(shell.outputStallMillis(), 10UL);
+
+    terminal.setWriteRoom(-1);
+    shell.executeIfInput();
+    assertEqual(shell.outputQueued(), (size_t) 0);
+    unsigned long stalled = shell.outputStallMillis();
+    ::delay(5);
+    assertEqual(shell.outputStallMillis(), stalled);  // no longer stalled
+
+    // the output that fit arrives intact and in order
+    char aLine[80];
+    assertEqual(terminal.getline(aLine, sizeof(aLine)),
+                "0123456789abcdefghijklmnopqrstuvwxyz" NEW_LINE
+                "0123456789abcdefghijklmnop");
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// many commands, to exercise long "help" listings
+static const char manyNames[][6] PROGMEM = {
+    "cmd00", "cmd01", "cmd02", "cmd03", "cmd04", "cmd05",
+    "cmd06", "cmd07", "cmd08", "cmd09", "cmd10", "cmd11",
+};
+
+int nothing(int, char **)
+{
+    return EXIT_SUCCESS;
+}
+
+// count the lines in the output (and discard it)
+static int outputLines(void)
+{
+    int lines = 0;
+    char c;
+    while (terminal.readOutput(&c, 1)) {
+        lines += (c == '\n');
+    }
+    return lines;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// printf() hands the connection a whole line at once, where chained
+// print() calls make a write() each (counted here as "blocked" writes)
+testF(StressTest, printfWrites)
+{
+    terminal.setWriteRoom(0);
+    shell.print(F("pin "));
+    shell.print(7);
+    shell.print(F(": "));
+    shell.print(512);
+    shell.println(F(" counts"));
+    unsigned long printWrites = terminal.blockedWrites();
+
+    char chained[32];
+    terminal.getline(chained, sizeof(chained));
+    terminal.setWriteRoom(0);
+    shell.printf(F("pin %d: %d counts\r\n"), 7, 512);
+    assertEqual(terminal.blockedWrites() - printWrites, 1UL);
+    assertMore(printWrites, 4UL);
+
+    char formatted[32];
+    assertEqual(terminal.getline(formatted, sizeof(formatted)), (const char *) chained);
+
+    // longer output goes out a bufferful at a time
+    terminal.setWriteRoom(0);
+    unsigned long before = terminal.blockedWrites();
+    assertEqual(shell.printf(F("%100s"), "x"), (size_t) 100);
+    assertEqual(terminal.blockedWrites() - before,
+                (unsigned long) (100 + SIMPLE_SERIAL_SHELL_PRINTF_BUFSIZE - 1)
+                / SIMPLE_SERIAL_SHELL_PRINTF_BUFSIZE);
+    terminal.setWriteRoom(-1);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// help lists a bounded number of commands per executeIfInput()
+testF(StressTest, incrementalHelp)
+{
+    terminal.pressKeys("help\r");
+    assertTrue(shell.executeIfInput());
+    // echoed newline, preamble and the first batch
+    assertEqual(outputLines(), 2 + SIMPLE_SERIAL_SHELL_HELP_LINES);
+
+    // 12 "cmd" + chatter + help + tally + unsubscribe = 16 commands
+    assertTrue(shell.executeIfInput());
+    assertEqual(outputLines(), 16 - SIMPLE_SERIAL_SHELL_HELP_LINES);
+
+    // then the prompt is back, and input is read again
+    terminal.pressKeys("tally\r");
+    assertTrue(shell.executeIfInput());
+    char aLine[32];
+    assertEqual(terminal.getline(aLine, sizeof(aLine)), "tally" COMMAND_PROMPT);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// a prefix limits the listing to a run of (sorted) commands
+testF(StressTest, helpPrefix)
+{
+    // (help is an asynchronous command; it finishes on a later call)
+    assertEqual(shell.execute("help cmd0"), SimpleSerialShell::PENDING);
+    assertEqual(outputLines(), 1 + SIMPLE_SERIAL_SHELL_HELP_LINES);
+    assertTrue(shell.executeIfInput());
+    assertEqual(outputLines(), 10 - SIMPLE_SERIAL_SHELL_HELP_LINES);
+    assertEqual(shell.lastErrNo(), 0);
+
+    assertEqual(shell.execute("help CMD1"), 0);
+    char aLine[64];
+    assertEqual(terminal.getline(aLine, sizeof(aLine)),
+                "Commands available are:" NEW_LINE
+                "  cmd10" NEW_LINE
+                "  cmd11" NEW_LINE);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// binary telemetry: framed samples at a fixed rate
+static SimpleSerialShell::Subscription subscriptions[2];
+static int16_t nextSample = 0;
+
+uint8_t sampleCounter(int16_t values[], unsigned long arg)
+{
+    values[0] = nextSample++;
+    values[1] = (int16_t) arg;
+    return 2;
+}
+
+// checks one frame from the output; returns its first value (or -1)
+static int readFrame(int id)
+{
+    uint8_t frame[10];  // 2 values, 1 byte delta
+    if (terminal.readOutput((char *) frame, sizeof(frame)) != sizeof(frame)) {
+        return -1;
+    }
+    uint16_t crc = SimpleSerialShell::crc16(frame + 1, 7);
+    if (frame[0] != 0xA5 || frame[1] != id || frame[2] != 2
+            || frame[8] != (crc & 0xff) || frame[9] != (crc >> 8)
+            || (int16_t)(frame[6] | (frame[7] << 8)) != -300) {
+        return -1;
+    }
+    return frame[4] | (frame[5] << 8);
+}
+
+testF(StressTest, telemetry)
+{
+    assertEqual(SimpleSerialShell::crc16("123456789", 9), 0x29B1);
+
+    nextSample = 0;
+    int id = shell.subscribe(sampleCounter, (unsigned long) -300, 5);
+    assertMore(id, 0);
+
+    // one at once, then one every 5 ms (waiting for ten, however slow
+    // the machine, rather than a set time)
+    unsigned long start = millis();
+    while (subscriptions[0].frames < 10 && millis() - start < 1000) {
+        shell.executeIfInput();
+    }
+    assertEqual(subscriptions[0].frames, 10UL);
+    assertMoreOrEqual(millis() - start, 40UL);
+    for (int i = 0; i < 10; i++) {
+        assertEqual(readFrame(id), i);
+    }
+    assertEqual(terminal.outputCount(), (size_t) 0);
+
+    // an output queue without room for a whole frame drops it
+    static uint8_t queue[16];
+    shell.setOutputQueue(queue, sizeof(queue));
+    terminal.setWriteRoom(0);
+    shell.print(F("12345678"));
+    ::delay(5);
+    shell.executeIfInput();
+    assertEqual(subscriptions[0].dropped, 1UL);
+    assertEqual(shell.outputQueued(), (size_t) 8);
+    terminal.setWriteRoom(-1);
+    shell.setOutputQueue(NULL, 0);
+    terminal.discardOutput();
+
+    assertEqual(shell.execute("unsubscribe 9"), -1);
+    assertEqual(shell.execute("unsubscribe"), 0);
+    terminal.discardOutput();
+    ::delay(5);
+    shell.executeIfInput();
+    assertEqual(terminal.outputCount(), (size_t) 0);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// ... so which sketch is this?
+int showID(int /*argc*/ = 0, char ** /*argv*/ = NULL)
+{
+    Serial.println();
+    Serial.println(F( "Running " __FILE__ ", Built " __DATE__));
+    return 0;
+};
+
+//////////////////////////////////////////////////////////////////////////////
+void setup() {
+    ::delay(1000); // wait for stability on some boards to prevent garbage Serial
+    Serial.begin(115200); // ESP8266 default of 74880 not supported on Linux
+    while (!Serial); // for the Arduino Leonardo/Micro only
+    showID();
+
+    shell.addCommand(F("tally [<n>]"), tally);
+    shell.addCommand(F("chatter [<lines>]"), chatter);
+    for (size_t i = 0; i < sizeof(manyNames) / sizeof(manyNames[0]); i++) {
+        shell.addCommand((const __FlashStringHelper *) manyNames[i], nothing);
+    }
+    shell.addTelemetryCommands(subscriptions, 2);
+    shell.attach(terminal);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+void loop() {
+    // Should get:
+    // TestRunner summary:
+    //   <n> passed, <n> failed, <n> skipped, <n> timed out, out of <n> test(s).
+    aunit::TestRunner::run();
+}
@@ -43,8 +43,90 @@ int sum(int argc, char **argv)
     return aSum;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// an asynchronous command: prints one number per call
+// "countdown 3" prints 3, 2, 1 then returns 0.
+//
+int countdown(int argc, char **argv, SimpleSerialShell::AsyncState & state)
+{
+    SHELL_ASYNC_BEGIN(state);
+    for (state.locals[0] = (argc > 1) ? atoi(argv[1]) : 3;
+            state.locals[0] > 0;
+            state.locals[0]--) {
+        if (shell.cancelRequested()) {
+            shell.println(F("countdown stopped"));  // clean up
+            return SimpleSerialShell::CANCELLED;
+        }
+        shell.println(state.locals[0]);
+        SHELL_ASYNC_YIELD(state);
+    }
+    SHELL_ASYNC_END(state);
+
+    return EXIT_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// "nap 50" finishes 50 milliseconds later (without blocking).
+//
+int nap(int argc, char **argv, SimpleSerialShell::AsyncState & state)
+{
+    SHELL_ASYNC_BEGIN(state);
+    SHELL_ASYNC_SLEEP(state, (argc > 1) ? atol(argv[1]) : 0);
+    SHELL_ASYNC_END(state);
+
+    return 7;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// a long-running (synchronous) command that stops for Ctrl-C
+//
+int spin(int /*argc*/, char ** /*argv*/)
+{
+    for (long i = 0; i < 1000000L; i++) {
+        if (shell.cancelRequested()) {
+            return SimpleSerialShell::CANCELLED;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// a composite command: runs the rest of its arguments (as a command) n times
+// "repeat 2 echo hi" prints "hi" twice.  Its own argv must survive.
+//
+int repeat(int argc, char **argv)
+{
+    int result = EXIT_SUCCESS;
+    for (int n = (argc > 2) ? atoi(argv[1]) : 0; n > 0; n--) {
+        char line[SIMPLE_SERIAL_SHELL_BUFSIZE] = "";
+        for (int i = 2; i < argc; i++) {
+            strcat(line, argv[i]);
+            strcat(line, " ");
+        }
+        result = shell.execute(line);
+    }
+    return result;
+}
+
+// "run sum 1 2" runs the rest of its arguments in place (nesting without
+// copying a line)
+int run(int argc, char **argv)
+{
+    return (argc > 1) ? shell.execute(argc - 1, argv + 1) : EXIT_SUCCESS;
+}
 
 void addTestCommands(void) {
+    shell.addCommand(F("repeat"), repeat);
+    shell.addCommand(F("run"), run);
+    shell.addCommand(F("spin"), spin);
     shell.addCommand(F("echo"), echo);
     shell.addCommand(F("sum"), sum);
+    shell.addAsyncCommand(F("countdown"), countdown);
+    shell.addAsyncCommand(F("nap"), nap);
+
+    // a group, with a group in it
+    SimpleSerialShell::Command * math = shell.addCommandGroup(F("math <command>"));
+    shell.addCommand(F("add <n>..."), sum, math);
+    SimpleSerialShell::Command * inner = shell.addCommandGroup(F("inner <command>"), math);
+    shell.addCommand(F("echo"), echo, inner);
 }
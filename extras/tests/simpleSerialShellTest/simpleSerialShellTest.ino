@@ -35,6 +35,8 @@ void prepForTests(void)
 {
     terminal.init();
     shell.resetBuffer();
+    shell.setOutputFormat(SimpleSerialShell::TEXT);
+    shell.setLineChecks(false);
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -252,6 +254,717 @@ testF(ShellTest, delete) {
     assertEqual(terminal.getline(), END_LINE "hello world" COMMAND_PROMPT);
 }
 
+//////////////////////////////////////////////////////////////////////////////
+// asynchronous commands are resumed by executeIfInput()
+testF(ShellTest, asyncCommand) {
+
+    int response = shell.execute("countdown 3");
+    assertEqual(response, SimpleSerialShell::PENDING);
+    assertEqual(shell.lastErrNo(), SimpleSerialShell::PENDING);
+    assertTrue(shell.isBusy());
+    assertEqual(terminal.getline(), "3" END_LINE);
+
+    // typed input waits until the command is finished
+    terminal.pressKeys("echo done\r");
+
+    assertTrue(shell.executeIfInput());
+    assertEqual(terminal.getline(), "2" END_LINE);
+    assertTrue(shell.executeIfInput());
+    assertEqual(terminal.getline(), "1" END_LINE);
+    assertTrue(shell.isBusy());
+
+    assertTrue(shell.executeIfInput());
+    assertFalse(shell.isBusy());
+    assertEqual(shell.lastErrNo(), 0);
+    assertEqual(terminal.getline(), "> ");
+
+    assertTrue(shell.executeIfInput());
+    assertEqual(terminal.getline(), "echo done" END_LINE "done" COMMAND_PROMPT);
+
+    // a synchronous command can't be pending, whatever it returns
+    char line[24];
+    snprintf(line, sizeof(line), "sum %d", SimpleSerialShell::PENDING);
+    assertEqual(shell.execute(line), -1);
+    assertFalse(shell.isBusy());
+    snprintf(line, sizeof(line), "run sum %d", SimpleSerialShell::PENDING);
+    assertEqual(shell.execute(line), -1);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// a synchronous command run meanwhile leaves a pending one where it was
+testF(ShellTest, syncDuringAsync) {
+
+    assertEqual(shell.execute("countdown 3"), SimpleSerialShell::PENDING);
+    assertTrue(shell.executeIfInput());
+    assertEqual(terminal.getline(), "3" END_LINE "2" END_LINE);
+
+    assertEqual(shell.execute("echo hi"), 0);
+    assertTrue(shell.isBusy());
+    assertTrue(shell.executeIfInput());
+    assertTrue(shell.executeIfInput());
+    assertFalse(shell.isBusy());
+    assertEqual(terminal.getline(), "hi" END_LINE "1" END_LINE "> ");
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// an asynchronous command can wait without blocking
+testF(ShellTest, asyncSleep) {
+
+    terminal.pressKeys("nap 20\r");
+    unsigned long start = millis();
+    assertTrue(shell.executeIfInput());
+    assertTrue(shell.isBusy());
+
+    int polls = 1;
+    while (shell.isBusy()) {
+        shell.executeIfInput();
+        polls++;
+    }
+    assertMoreOrEqual(millis() - start, 20UL);
+    assertMore(polls, 2);
+    assertEqual(shell.lastErrNo(), 7);
+    assertEqual(terminal.getline(), "nap 20" COMMAND_PROMPT);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Ctrl-C stops a running command
+testF(ShellTest, cancelCommand) {
+
+    // a synchronous command polls for it
+    terminal.pressKeys("spin\r\x03");
+    assertTrue(shell.executeIfInput());
+    assertEqual(shell.lastErrNo(), SimpleSerialShell::CANCELLED);
+    assertEqual(terminal.getline(), "spin" COMMAND_PROMPT);
+
+    // ... past the linefeed of a "\r\n" terminal
+    terminal.pressKeys("spin\r\n\x03");
+    assertTrue(shell.executeIfInput());
+    assertEqual(shell.lastErrNo(), SimpleSerialShell::CANCELLED);
+    assertEqual(terminal.getline(), "spin" COMMAND_PROMPT);
+
+    // an asynchronous command gets a last call to clean up
+    assertEqual(shell.execute("countdown 5"), SimpleSerialShell::PENDING);
+    terminal.pressKey(0x03);
+    assertTrue(shell.executeIfInput());
+    assertFalse(shell.isBusy());
+    assertEqual(shell.lastErrNo(), SimpleSerialShell::CANCELLED);
+    assertEqual(terminal.getline(),
+                "5" END_LINE "countdown stopped" END_LINE "^C" COMMAND_PROMPT);
+
+    // ... or is stopped anyway
+    assertEqual(shell.execute("nap 10000"), SimpleSerialShell::PENDING);
+    terminal.pressKey(0x03);
+    assertTrue(shell.executeIfInput());
+    assertFalse(shell.isBusy());
+    assertEqual(shell.lastErrNo(), SimpleSerialShell::CANCELLED);
+    assertEqual(terminal.getline(), "^C" COMMAND_PROMPT);
+
+    // with nothing running, Ctrl-C abandons the line
+    terminal.pressKeys("echo oops\x03");
+    assertFalse(shell.executeIfInput());
+    assertEqual(terminal.getline(), "echo oops^C" END_LINE);
+    assertEqual(shell.execute("sum 1 2"), 3);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// commands run from the sketch leave a half-typed line alone
+testF(ShellTest, executeFromSketch) {
+
+    terminal.pressKeys("echo typ");
+    assertFalse(shell.executeIfInput());
+    assertEqual(terminal.getline(), "echo typ");
+
+    assertEqual(shell.execute("sum 1 2"), 3);
+
+    char * argv[] = { (char *) "sum", (char *) "4", (char *) "5" };
+    assertEqual(shell.execute(3, argv), 9);
+    assertEqual(shell.lastErrNo(), 9);
+
+    char line[] = "echo  in\tplace";
+    assertEqual(shell.executeInPlace(line), 0);
+    assertEqual(terminal.getline(), "in place" END_LINE);
+
+    // an asynchronous command keeps the caller's arguments
+    char * napArgv[] = { (char *) "nap", (char *) "1" };
+    assertEqual(shell.execute(2, napArgv), SimpleSerialShell::PENDING);
+    assertEqual(shell.execute("countdown 1"), -1);  // one at a time
+    assertEqual(terminal.getline(), "-1: busy" END_LINE);
+    assertEqual(shell.execute("sum 2 2"), 4);       // (synchronous is fine)
+    while (shell.isBusy()) {
+        shell.executeIfInput();
+    }
+    assertEqual(shell.lastErrNo(), 7);
+    assertEqual(terminal.getline(), "> ");
+
+    // ... and its own copy of a line's
+    assertEqual(shell.execute("countdown 2"), SimpleSerialShell::PENDING);
+    while (shell.isBusy()) {
+        shell.executeIfInput();
+    }
+    assertEqual(terminal.getline(), "2" END_LINE "1" END_LINE "> ");
+
+    terminal.pressKeys("ed more\r");
+    assertTrue(shell.executeIfInput());
+    assertEqual(terminal.getline(), "ed more" END_LINE "typed more" COMMAND_PROMPT);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// commands can run commands
+testF(ShellTest, nestedExecute) {
+
+    terminal.pressKeys("repeat 2 echo hi\r");
+    assertTrue(shell.executeIfInput());
+    assertEqual(terminal.getline(), "repeat 2 echo hi" END_LINE "hi" END_LINE "hi" COMMAND_PROMPT);
+
+    assertEqual(shell.execute("repeat 1 repeat 2 sum 1 2"), 3);
+
+    // a nested asynchronous command is finished in place
+    assertEqual(shell.execute("repeat 2 nap 2"), 7);
+    assertFalse(shell.isBusy());
+
+    // nesting is bounded: in depth...
+    assertEqual(shell.execute("run run run sum 5"), 5);
+    assertEqual(shell.execute("run run run run sum 5"), -1);
+    assertEqual(terminal.getline(), "-1: nested too deeply" END_LINE);
+
+    // ... and in the room for copies of the lines
+    assertEqual(shell.execute("repeat 1 echo 0123456789 0123456789 01234567"), 0);
+    assertEqual(terminal.getline(), "0123456789 0123456789 01234567" END_LINE);
+    assertEqual(shell.execute("repeat 1 echo 0123456789 0123456789 0123456789 0123"), -1);
+    assertEqual(terminal.getline(), "-1: line too long for nesting" END_LINE);
+
+    // (a capture or pipe isn't a level)
+    char buffer[8];
+    assertEqual(shell.capture(buffer, sizeof(buffer), "run run run echo hi"), 0);
+    assertEqual(buffer, "hi" END_LINE);
+    assertEqual(shell.execute("run run run echo hi | wc"), 0);
+    assertEqual(terminal.getline(), "1 1 4" END_LINE);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// "command | filter" streams output through a small buffer to the filter
+testF(ShellTest, pipes) {
+
+    // (more output than SIMPLE_SERIAL_SHELL_PIPE_BUFSIZE)
+    assertEqual(shell.execute("countdown 12 | wc"), 0);
+    assertEqual(terminal.getline(), "12 12 39" END_LINE);
+
+    assertEqual(shell.execute("countdown 12 | grep 1"), 0);
+    assertEqual(terminal.getline(), "12" END_LINE "11" END_LINE "10" END_LINE "1" END_LINE);
+    assertEqual(shell.execute("echo abc | grep x"), 1);
+    assertEqual(terminal.getline(), "");
+
+    terminal.pressKeys("echo a b | wc\r");
+    assertTrue(shell.executeIfInput());
+    assertEqual(terminal.getline(), "echo a b | wc" END_LINE "1 2 5" COMMAND_PROMPT);
+
+    // a failing command isn't hidden by its filter
+    assertEqual(shell.execute("sum 2 | wc"), 2);
+    assertEqual(terminal.getline(), "0 0 0" END_LINE);
+
+    assertEqual(shell.execute("echo hi | nope"), -1);
+    assertEqual(terminal.getline(), "\"nope\": -1: command not found" END_LINE);
+
+    // outside a pipe a filter has no input
+    assertEqual(shell.execute("grep x"), 1);
+    assertFalse(shell.isBusy());
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// capture() runs a command into a buffer, truncating like snprintf()
+testF(ShellTest, capture) {
+
+    char buffer[8];
+    size_t length = 0;
+    assertEqual(shell.capture(buffer, sizeof(buffer), "echo hello", &length), 0);
+    assertEqual(buffer, "hello" END_LINE);
+    assertEqual(length, (size_t) 7);
+
+    assertEqual(shell.capture(buffer, sizeof(buffer), "echo hello world", &length), 0);
+    assertEqual(buffer, "hello w");
+    assertEqual(length, (size_t) 13);
+
+    // asynchronous commands and pipes are finished inside
+    assertEqual(shell.capture(buffer, sizeof(buffer), "countdown 2"), 0);
+    assertEqual(buffer, "2" END_LINE "1" END_LINE);
+    assertFalse(shell.isBusy());
+    assertEqual(shell.capture(buffer, sizeof(buffer), "countdown 12 | wc"), 0);
+    assertEqual(buffer, "12 12 3");
+
+    assertEqual(shell.capture(buffer, sizeof(buffer), "nope"), -1);
+    assertEqual(terminal.getline(), "");    // nothing reached the connection
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// commands can be grouped ("math add 1 2"; see addTestCommands())
+testF(ShellTest, commandGroups) {
+
+    assertEqual(shell.execute("math add 1 2"), 3);
+    assertEqual(shell.execute("MATH Inner echo hi"), 0);
+    assertEqual(terminal.getline(), "hi" END_LINE);
+
+    // a group alone lists its commands
+    assertEqual(shell.execute("math"), 0);
+    assertEqual(terminal.getline(), "  math add <n>..." END_LINE "  math inner <command>" END_LINE);
+    assertEqual(shell.execute("math nope"), -1);
+    assertEqual(terminal.getline(), "\"nope\": -1: command not found" END_LINE);
+    assertEqual(shell.execute("add 1"), -1);    // not at the top level
+    terminal.getline();
+
+    assertEqual(shell.execute("help math inner"), 0);
+    assertEqual(terminal.getline(), "Commands available are:" END_LINE "  inner echo" END_LINE);
+    assertEqual(shell.execute("help math a"), 0);
+    assertEqual(terminal.getline(), "Commands available are:" END_LINE "  math add <n>..." END_LINE);
+
+    // aliases, jobs and pipes look through groups too
+    assertEqual(shell.execute("alias plus = math add 2"), 0);
+    assertEqual(shell.execute("plus 3"), 5);
+    assertEqual(shell.execute("unalias plus"), 0);
+    assertEqual(shell.execute("echo a b | math inner echo"), 0);
+    assertEqual(terminal.getline(), END_LINE);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// one handler can serve several commands through a context pointer
+int readCounter(int argc, char ** /*argv*/, void * context)
+{
+    int & counter = *(int *) context;
+    return (argc > 1) ? ++counter : counter;
+}
+
+int counters[2] = {10, 20};
+
+testF(ShellTest, commandContext) {
+
+    shell.addCommand(F("counter1 [bump]"), readCounter, &counters[0]);
+    shell.addCommand(F("counter2 [bump]"), readCounter, &counters[1]);
+    assertEqual(shell.execute("counter1"), 10);
+    assertEqual(shell.execute("counter2 bump"), 21);
+    assertEqual(shell.execute("counter1 bump"), 11);
+    assertEqual(counters[0], 11);
+
+    assertTrue(shell.removeCommand("counter1"));
+    assertTrue(shell.removeCommand("counter2"));
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// commands can be removed or replaced, even while running
+int answer42(int /*argc*/, char ** /*argv*/) { return 42; }
+int answer43(int /*argc*/, char ** /*argv*/) { return 43; }
+
+int removeSelf(int /*argc*/, char ** /*argv*/)
+{
+    return shell.removeCommand("removeself") ? 5 : -5;
+}
+
+testF(ShellTest, unregister) {
+
+    shell.addCommand(F("answer"), answer42);
+    assertEqual(shell.execute("answer"), 42);
+    assertEqual(shell.execute("alias a = answer"), 0);
+    assertEqual(shell.execute("every 1000 answer"), 0);
+    terminal.getline();
+
+    // jobs and aliases follow a replacement...
+    shell.replaceCommand(F("answer"), answer43);
+    assertEqual(shell.execute("answer"), 43);
+    assertEqual(shell.execute("a"), 43);
+    char jobList[64];
+    shell.capture(jobList, sizeof(jobList), "jobs");
+    assertTrue(strstr(jobList, "answer") != NULL);
+
+    // ... but not a removal
+    assertTrue(shell.removeCommand("answer"));
+    assertFalse(shell.removeCommand("answer"));
+    assertEqual(shell.execute("answer"), -1);
+    terminal.getline();
+    assertEqual(shell.execute("a"), -1);
+    assertEqual(terminal.getline(), "\"answer\": -1: command removed" END_LINE);
+    shell.capture(jobList, sizeof(jobList), "jobs");
+    assertEqual(jobList, "");
+    assertEqual(shell.execute("unalias a"), 0);
+
+    // a command can remove itself
+    shell.addCommand(F("removeself"), removeSelf);
+    assertEqual(shell.execute("removeself"), 5);
+    assertEqual(shell.execute("removeself"), -1);
+    terminal.getline();
+
+    // removing a group removes its commands
+    SimpleSerialShell::Command * group = shell.addCommandGroup(F("tmpgroup"));
+    shell.addCommand(F("answer"), answer42, group);
+    assertEqual(shell.execute("tmpgroup answer"), 42);
+    assertTrue(shell.removeCommand("tmpgroup"));
+    assertEqual(shell.execute("tmpgroup answer"), -1);
+    terminal.getline();
+
+    // a listing in progress skips what was removed meanwhile
+    terminal.pressKeys("help\r");
+    assertTrue(shell.executeIfInput());
+    assertTrue(shell.isBusy());
+    shell.addCommand(F("zzz"), answer42);   // (listed last)
+    assertTrue(shell.removeCommand("zzz"));
+    while (shell.isBusy()) {
+        assertTrue(shell.executeIfInput());
+        String aLine = terminal.getline();
+        assertTrue(aLine.indexOf('z') < 0);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// symbol tables: sorted at compile time, searched without copying to RAM
+static constexpr SimpleSerialShell::Symbol colours[] PROGMEM = {
+    {"blue", 3},
+    {"Green", 2},
+    {"navy", 3},
+    {"red", 1},
+};
+static_assert(SimpleSerialShell::symbolsSorted(colours), "colours must be sorted");
+
+testF(ShellTest, symbolTables) {
+
+    int value = 0;
+    assertTrue(SimpleSerialShell::lookupSymbol("red", colours, value));
+    assertEqual(value, 1);
+    assertTrue(SimpleSerialShell::lookupSymbol("GREEN", colours, value));
+    assertEqual(value, 2);
+    assertTrue(SimpleSerialShell::lookupSymbol("blue", colours, value));
+    assertEqual(value, 3);
+    assertFalse(SimpleSerialShell::lookupSymbol("purple", colours, value));
+    assertFalse(SimpleSerialShell::lookupSymbol("", colours, value));
+
+    assertEqual(String(SimpleSerialShell::symbolName(3, colours)), "blue");
+    assertTrue(SimpleSerialShell::symbolName(4, colours) == NULL);
+
+    SimpleSerialShell::printSymbols(shell, colours);
+    assertEqual(terminal.getline(), "{blue|Green|navy|red}");
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// dump() prints rows of hex and text
+static const char dumpBytes[] = "Hello,\tworld!\x7f\x80\xff";
+
+uint8_t readDumpBytes(unsigned long address)
+{
+    return dumpBytes[address & 0xF];
+}
+
+testF(ShellTest, dump) {
+
+    assertEqual(shell.dump(readDumpBytes, 0, 16), 0);
+    assertEqual(terminal.getline(),
+                "0 48 65 6C 6C 6F 2C 09 77 6F 72 6C 64 21 7F 80 FF Hello,.world!..." END_LINE);
+
+    // a short row keeps the text lined up
+    assertEqual(shell.dump(readDumpBytes, 0x1F0, 5), 0);
+    assertEqual(terminal.getline(), "1F0 48 65 6C 6C 6F" "                                  " "Hello" END_LINE);
+
+    assertEqual(shell.dump(SimpleSerialShell::readRam, (uintptr_t) dumpBytes, 0), 0);
+    assertEqual(terminal.getline(), "");
+    assertEqual(SimpleSerialShell::readRam((uintptr_t) dumpBytes), 'H');
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// printf() formats without the C library (or floating point printf)
+testF(ShellTest, printf) {
+
+    assertEqual(shell.printf(F("%d|%5d|%-4d|%05d|%u"), -12, 34, 5, -42, 65535u), (size_t) 26);
+    assertEqual(terminal.getline(), "-12|   34|5   |-0042|65535");
+
+    shell.printf(F("%x|%04X|%lx|%ld|%lu"), 0xbeef, 0xA, 0xDEADBEEFUL, -2000000000L, 4000000000UL);
+    assertEqual(terminal.getline(), "beef|000A|deadbeef|-2000000000|4000000000");
+
+    shell.printf(F("%.2f|%f|%7.1f|%.0f|%f"), 3.14159, -0.5, 2.26, 99.5, 1e10);
+    assertEqual(terminal.getline(), "3.14|-0.500000|    2.3|100|ovf");
+
+    shell.printf("%s|%.3s|%-3S|%c|100%%|%q", "abc", "abcdef", F("x"), '!');
+    assertEqual(terminal.getline(), "abc|abc|x  |!|100%|q");
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// records are printed as text, JSON Lines or CSV
+static void sampleRecord(void)
+{
+    shell.beginRecord(F("adc"));
+    shell.field(F("pin"), 5);
+    shell.field(F("v"), 1.5);
+    shell.field(F("ok"), true);
+    shell.field(F("tag"), "a\"b,c");
+    shell.endRecord();
+}
+
+testF(ShellTest, records) {
+
+    sampleRecord();
+    assertEqual(terminal.getline(), "pin: 5, v: 1.50, ok: true, tag: a\"b,c" END_LINE);
+
+    assertEqual(shell.execute("format json"), 0);
+    sampleRecord();
+    assertEqual(terminal.getline(),
+                "{\"record\":\"adc\",\"pin\":5,\"v\":1.50,\"ok\":true,\"tag\":\"a\\\"b,c\"}" END_LINE);
+
+    // no echo or prompt, and errors are records too
+    terminal.pressKeys("nope\r");
+    assertTrue(shell.executeIfInput());
+    assertEqual(terminal.getline(),
+                "{\"record\":\"error\",\"code\":-1,\"name\":\"nope\",\"message\":\"command not found\"}" END_LINE);
+
+    shell.setOutputFormat(SimpleSerialShell::CSV);
+    sampleRecord();
+    assertEqual(terminal.getline(), "adc,5,1.50,true,\"a\"\"b,c\"" END_LINE);
+    assertEqual(shell.execute("format"), 0);
+    assertEqual(terminal.getline(), "csv" END_LINE);
+    assertEqual(shell.execute("format xml"), -1);
+    assertEqual(terminal.getline(), "usage: format {csv|json|text}" END_LINE);
+
+    assertEqual(shell.execute("format TEXT"), 0);
+    assertEqual(shell.execute("nope"), -1);
+    assertEqual(terminal.getline(), "\"nope\": -1: command not found" END_LINE);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// with line checks, lines carry a seq and CRC, and responses a status line
+// with the CRC of everything printed
+static void typeCheckedLine(const char * line, bool damaged = false)
+{
+    char framed[40];
+    int n = strlen(line);
+    snprintf(framed, sizeof(framed), "%s*%04X\r", line,
+             SimpleSerialShell::crc16(line, n) ^ (damaged ? 1 : 0));
+    terminal.pressKeys(framed);
+    shell.executeIfInput();
+}
+
+// output, then its status line
+static String checkedResponse(const char * output, const char * status)
+{
+    char response[64];
+    snprintf(response, sizeof(response), "%s%s", output, status);
+    uint16_t crc = SimpleSerialShell::crc16(response, strlen(response));
+    snprintf(response, sizeof(response), "%s%s*%04X\r\n", output, status, crc);
+    return String(response);
+}
+
+testF(ShellTest, lineChecks) {
+
+    shell.setLineChecks(true);
+
+    typeCheckedLine("01 echo hi");      // (no echo or prompt)
+    assertEqual(terminal.getline(), checkedResponse("hi" END_LINE, "+01 0"));
+
+    typeCheckedLine("02 sum 2 3", true);
+    assertEqual(terminal.getline(), checkedResponse("", "-02"));
+    typeCheckedLine("02 sum 2 3");
+    assertEqual(terminal.getline(), checkedResponse("", "+02 5"));
+
+    // a repeat isn't run again; its response is sent again
+    typeCheckedLine("02 echo again");
+    assertEqual(terminal.getline(), checkedResponse("", "+02 5"));
+    typeCheckedLine("03 echo hi");
+    assertEqual(terminal.getline(), checkedResponse("hi" END_LINE, "+03 0"));
+    typeCheckedLine("03 echo hi");
+    assertEqual(terminal.getline(), checkedResponse("hi" END_LINE, "+03 0"));
+
+    // ... if it was kept
+    typeCheckedLine("04 repeat 6 echo 123456789");
+    terminal.getline();
+    typeCheckedLine("04 repeat 6 echo 123456789");
+    assertEqual(terminal.getline(), checkedResponse("", "!04 0"));
+
+    // ... the shell's own reports included
+    typeCheckedLine("05 nosuch");
+    assertEqual(terminal.getline(),
+                checkedResponse("\"nosuch\": -1: command not found" END_LINE, "+05 -1"));
+    typeCheckedLine("05 nosuch");
+    assertEqual(terminal.getline(),
+                checkedResponse("\"nosuch\": -1: command not found" END_LINE, "+05 -1"));
+
+    // nor is anything unframed
+    terminal.pressKeys("echo plain\r");
+    shell.executeIfInput();
+    assertEqual(terminal.getline(), checkedResponse("", "-??"));
+
+    // an asynchronous command's status follows its last output
+    typeCheckedLine("06 countdown 1");
+    shell.executeIfInput();
+    assertEqual(terminal.getline(), checkedResponse("1" END_LINE, "+06 0"));
+
+    shell.setLineChecks(false);
+    terminal.pressKeys("echo plain\r");
+    shell.executeIfInput();
+    assertEqual(terminal.getline(), "echo plain" END_LINE "plain" COMMAND_PROMPT);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// "every" runs a command periodically from executeIfInput()
+SimpleSerialShell::Job jobs[2];
+
+testF(ShellTest, scheduler) {
+
+    assertEqual(shell.execute("every 10 echo tick"), 0);
+    assertEqual(terminal.getline(), "[1]" END_LINE);
+
+    // (wait for three, however slow the machine, rather than a set time)
+    String ticks;
+    unsigned long start = millis();
+    while (ticks.length() < 3 * strlen("tick" END_LINE) && millis() - start < 1000) {
+        assertFalse(shell.executeIfInput());
+        ticks += terminal.getline();
+    }
+    assertEqual(ticks, "tick" END_LINE "tick" END_LINE "tick" END_LINE);
+    assertMoreOrEqual(millis() - start, 20UL);
+
+    assertEqual(shell.execute("kill 1"), 0);
+    ::delay(15);
+    assertFalse(shell.executeIfInput());
+    assertEqual(terminal.getline(), "");
+    assertEqual(shell.execute("kill 1"), -1);
+    assertEqual(terminal.getline(), "-1: no such job" END_LINE);
+
+    // a late job runs once, counts what it missed, and leaves lastErrNo alone
+    assertEqual(shell.execute("every 10 sum 1 2"), 0);
+    assertEqual(terminal.getline(), "[2]" END_LINE);
+    assertEqual(shell.execute("sum 1 2 3"), 6);
+    ::delay(35);
+    shell.executeIfInput();
+    assertEqual(shell.lastErrNo(), 6);
+
+    assertEqual(shell.execute("jobs"), 0);
+    String listing = terminal.getline();
+    assertTrue(listing.startsWith("[2] every 10 sum 1 2 (runs 1, overruns "));
+    assertTrue(listing.endsWith(", last 3)" END_LINE));
+    assertFalse(listing.startsWith("[2] every 10 sum 1 2 (runs 1, overruns 0"));
+
+    // slots are limited; asynchronous commands can't be scheduled
+    assertEqual(shell.execute("every 1000 nap 1"), -1);
+    assertEqual(terminal.getline(), "-1: can't schedule an asynchronous command" END_LINE);
+    assertEqual(shell.execute("every 1000 echo a"), 0);
+    assertEqual(shell.execute("every 1000 echo b"), -1);
+    assertEqual(terminal.getline(), "[3]" END_LINE "-1: no free job slots" END_LINE);
+
+    assertEqual(shell.execute("kill 2"), 0);
+    assertEqual(shell.execute("kill 3"), 0);
+
+    // a job's output isn't part of a checked line's response
+    assertEqual(shell.execute("every 1 echo tick"), 0);
+    terminal.getline();
+    shell.setLineChecks(true);
+    typeCheckedLine("01 countdown 2");
+    for (int i = 0; i < 2; i++) {
+        ::delay(2);
+        shell.executeIfInput();
+    }
+    String response = terminal.getline();
+    assertTrue(response.indexOf("tick") >= 0);
+    response.replace("tick" END_LINE, "");
+    assertEqual(response, checkedResponse("2" END_LINE "1" END_LINE, "+01 0"));
+    shell.setLineChecks(false);
+    assertEqual(shell.execute("kill 4"), 0);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// aliases run pre-tokenized command sequences
+char aliasArena[128];
+
+testF(ShellTest, alias) {
+
+    assertEqual(shell.execute("alias greet = echo hi && sum 1 2"), 0);
+    assertEqual(shell.execute("greet"), 3);
+    assertEqual(terminal.getline(), "hi" END_LINE);
+    assertEqual(shell.execute("GREET 4"), 7);   // extra arguments go to the last step
+    assertEqual(shell.lastErrNo(), 7);
+    assertEqual(terminal.getline(), "hi" END_LINE);
+
+    // a failing step ends the alias
+    assertEqual(shell.execute("alias check = sum 1 && echo no"), 0);
+    assertEqual(shell.execute("check"), 1);
+    assertEqual(terminal.getline(), "");
+
+    // redefining replaces; "alias" lists them
+    assertEqual(shell.execute("alias greet = echo bye"), 0);
+    assertEqual(shell.execute("alias"), 0);
+    assertEqual(terminal.getline(),
+                "check = sum 1 && echo no" END_LINE
+                "greet = echo bye" END_LINE);
+
+    assertEqual(shell.execute("alias echo = sum 1"), -1);
+    assertEqual(terminal.getline(), "-1: alias would hide a command" END_LINE);
+    assertEqual(shell.execute("alias x = nope"), -1);
+    assertEqual(terminal.getline(), "\"nope\": -1: command not found" END_LINE);
+    assertEqual(shell.execute("alias long = echo 0123456789 0123456789 0123456789 0123456789"), -1);
+    assertEqual(terminal.getline(), "-1: alias space full" END_LINE);
+
+    assertEqual(shell.execute("unalias greet"), 0);
+    assertEqual(shell.execute("unalias check"), 0);
+    assertEqual(shell.execute("unalias check"), -1);
+    assertEqual(shell.execute("greet"), -1);
+    assertEqual(terminal.getline(),
+                "-1: no such alias" END_LINE
+                "\"greet\": -1: command not found" END_LINE);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// arrow keys recall history and move within the line, redrawing minimally
+#define UP "\x1b[A"
+#define DOWN "\x1b[B"
+#define RIGHT "\x1b[C"
+#define LEFT "\x1b[D"
+
+char historyBuffer[32];
+
+testF(ShellTest, history) {
+
+    shell.setHistory(historyBuffer, sizeof(historyBuffer));
+    terminal.pressKeys("echo one\recho two\r");
+    while (shell.executeIfInput()) {
+    }
+    terminal.getline();
+
+    terminal.pressKeys(UP);
+    assertFalse(shell.executeIfInput());
+    assertEqual(terminal.getline(), "echo two");
+
+    // only the differing end of the line is redrawn
+    terminal.pressKeys(UP);
+    shell.executeIfInput();
+    assertEqual(terminal.getline(), "\b\b\bone");
+
+    terminal.pressKeys(UP);     // (there is nothing older)
+    shell.executeIfInput();
+    assertEqual(terminal.getline(), "");
+
+    terminal.pressKeys(DOWN DOWN);
+    shell.executeIfInput();
+    assertEqual(terminal.getline(), "\b\b\btwo" "\x1b[8D\x1b[K");
+
+    // insert in the middle of a line
+    // (parameters, as in Ctrl-Right's ESC [ 1 ; 5 C, are skipped)
+    terminal.pressKeys("echo hllo" LEFT LEFT LEFT "e" RIGHT "\x1b[1;5C" "\r");
+    assertTrue(shell.executeIfInput());
+    assertEqual(terminal.getline(), "echo hllo" "\b\b\b" "ello\b\b\b" "l" "l"
+                END_LINE "hello" COMMAND_PROMPT);
+
+    // delete in the middle of a line
+    terminal.pressKeys("sum 12 3" LEFT LEFT "\b\r");
+    assertTrue(shell.executeIfInput());
+    assertEqual(shell.lastErrNo(), 4);
+    assertEqual(terminal.getline(), "sum 12 3" "\b\b" "\b 3 \b\b\b" COMMAND_PROMPT);
+
+    // "echo one" was forgotten to make room
+    terminal.pressKeys(UP UP UP UP "\r");
+    assertTrue(shell.executeIfInput());
+    assertEqual(shell.lastErrNo(), 0);
+    String aLine = terminal.getline();
+    assertTrue(aLine.endsWith(END_LINE "two" COMMAND_PROMPT));
+
+    // a lone ESC doesn't swallow the key after it
+    terminal.pressKeys("echo h\x1bi\r");
+    assertTrue(shell.executeIfInput());
+    assertEqual(terminal.getline(), "echo hi" END_LINE "hi" COMMAND_PROMPT);
+
+    shell.setHistory(NULL, 0);
+}
+
 //////////////////////////////////////////////////////////////////////////////
 // ... so which sketch is this?
 int showID(int /*argc*/ = 0, char ** /*argv*/ = NULL)
@@ -271,6 +984,10 @@ void setup() {
     shell.addCommand(F("id?"), showID);
 
     addTestCommands();
+    shell.addSchedulerCommands(jobs, sizeof(jobs) / sizeof(jobs[0]));
+    shell.addAliasCommands(aliasArena, sizeof(aliasArena));
+    shell.addFilterCommands();
+    shell.addFormatCommand();
 }
 
 //////////////////////////////////////////////////////////////////////////////
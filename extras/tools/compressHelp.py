@@ -0,0 +1,186 @@
+#!/usr/bin/env python3
+"""compressHelp.py -- shrink SimpleSerialShell command documentation.
+
+Reads command strings (one per line, "name documentation...") and writes a
+C++ header holding:
+
+  * helpDictionary -- a packed PROGMEM dictionary of common substrings
+  * one HELP_<name> macro per command, usable in place of F("...")
+
+Pass the dictionary to shell.setHelpDictionary() and register commands with
+the generated macros:
+
+    #include "helpText.h"
+    ...
+    shell.setHelpDictionary(FPSTR_HELP(helpDictionary));
+    shell.addCommand(HELP_setpinmode, setPinMode);
+
+Command names are never compressed (the shell matches them as typed); only
+the documentation after the first space is.  Each dictionary reference costs
+one byte (0x80 + index), so up to 128 entries can be used.
+
+Usage:
+    python3 compressHelp.py commands.txt -o helpText.h
+"""
+
+import argparse
+import re
+import sys
+
+MAX_ENTRIES = 128
+MAX_ENTRY_LEN = 32
+MIN_ENTRY_LEN = 2
+
+
+def split_command(line):
+    name, _, docs = line.partition(' ')
+    return name, docs
+
+
+def savings(text, occurrences):
+    # every use shrinks len(text) bytes to 1; the entry costs len + 1 bytes
+    return occurrences * (len(text) - 1) - (len(text) + 1)
+
+
+def count_substrings(docs):
+    """Count non-overlapping occurrences of each candidate substring.
+
+    docs is a list of token lists; a token is either a str (plain text) or
+    an int (an existing dictionary reference, which can't be re-used).
+    """
+    counts = {}
+    for tokens in docs:
+        for token in tokens:
+            if not isinstance(token, str):
+                continue
+            seen_end = {}
+            for start in range(len(token)):
+                for end in range(start + MIN_ENTRY_LEN,
+                                 min(len(token), start + MAX_ENTRY_LEN) + 1):
+                    sub = token[start:end]
+                    if seen_end.get(sub, 0) > start:
+                        continue    # overlaps the previous occurrence
+                    seen_end[sub] = end
+                    counts[sub] = counts.get(sub, 0) + 1
+    return counts
+
+
+def substitute(tokens, text, code):
+    result = []
+    for token in tokens:
+        if not isinstance(token, str):
+            result.append(token)
+            continue
+        parts = token.split(text)
+        for i, part in enumerate(parts):
+            if i:
+                result.append(code)
+            if part:
+                result.append(part)
+    return result
+
+
+def build_dictionary(commands):
+    docs = [[split_command(c)[1]] for c in commands]
+    dictionary = []
+    while len(dictionary) < MAX_ENTRIES:
+        counts = count_substrings(docs)
+        best, best_saving = None, 0
+        for text, n in counts.items():
+            s = savings(text, n)
+            if s > best_saving or (s == best_saving and best and text < best):
+                best, best_saving = text, s
+        if best is None:
+            break
+        code = len(dictionary)
+        dictionary.append(best)
+        docs = [substitute(tokens, best, code) for tokens in docs]
+    return dictionary, docs
+
+
+def c_literal(data):
+    """Render bytes as C string literal(s), splitting after hex escapes so
+    a following hex digit is not swallowed by the escape."""
+    out = ['"']
+    after_hex = False
+    for b in data:
+        ch = chr(b)
+        if after_hex and ch in '0123456789abcdefABCDEF':
+            out.append('" "')
+        after_hex = False
+        if ch in '"\\':
+            out.append('\\' + ch)
+        elif 0x20 <= b < 0x7f:
+            out.append(ch)
+        else:
+            out.append('\\x%02x' % b)
+            after_hex = True
+    out.append('"')
+    return ''.join(out)
+
+
+def encode(name, tokens):
+    data = bytearray(name.encode('ascii'))
+    if tokens:
+        data += b' '
+    for token in tokens:
+        if isinstance(token, str):
+            data += token.encode('ascii')
+        else:
+            data.append(0x80 + token)
+    return bytes(data)
+
+
+def macro_name(name, used):
+    base = 'HELP_' + re.sub(r'[^A-Za-z0-9_]', '_', name)
+    macro, n = base, 2
+    while macro in used:
+        macro, n = '%s_%d' % (base, n), n + 1
+    used.add(macro)
+    return macro
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('commands', type=argparse.FileType('r'),
+                        help='file with one command string per line')
+    parser.add_argument('-o', '--output', type=argparse.FileType('w'),
+                        default=sys.stdout, help='header to write')
+    args = parser.parse_args()
+
+    commands = [line.rstrip('\r\n') for line in args.commands]
+    commands = [c for c in commands if c.strip() and not c.startswith('#')]
+    for c in commands:
+        if any(ord(ch) >= 0x80 for ch in c):
+            sys.exit('compressHelp: non-ASCII text is not supported: %r' % c)
+
+    dictionary, docs = build_dictionary(commands)
+
+    raw = sum(len(c) + 1 for c in commands)
+    packed = sum(len(d) + 1 for d in dictionary) + 1
+    encoded = []
+    for command, tokens in zip(commands, docs):
+        name, _ = split_command(command)
+        encoded.append((name, encode(name, [t for t in tokens if t != ''])))
+    packed += sum(len(e) + 1 for _, e in encoded)
+
+    out = args.output
+    out.write('// Generated by compressHelp.py -- do not edit.\n')
+    out.write('// %d bytes of command strings packed into %d bytes.\n'
+              % (raw, packed))
+    out.write('#pragma once\n#include <Arduino.h>\n\n')
+    out.write('#define FPSTR_HELP(p) ((const __FlashStringHelper *)(p))\n\n')
+    out.write('static const char helpDictionary[] PROGMEM =\n')
+    for code, text in enumerate(dictionary):
+        entry = bytes([len(text)]) + text.encode('ascii')
+        out.write('    %s  // 0x%02x\n' % (c_literal(entry), 0x80 + code))
+    out.write('    "";  // (ends with a zero length)\n\n')
+
+    used = set()
+    for name, data in encoded:
+        out.write('#define %s F(%s)\n' % (macro_name(name, used),
+                                         c_literal(data)))
+
+
+if __name__ == '__main__':
+    main()
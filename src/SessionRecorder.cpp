@@ -0,0 +1,358 @@
+#include <Arduino.h>
+#include <SessionRecorder.h>
+
+////////////////////////////////////////////////////////////////////////////////
+/*!
+ *  @file SessionRecorder.cpp
+ *
+ *  Implementation for session record and replay.
+ *
+ */
+
+static const char signature[] = "SSR1";
+
+//////////////////////////////////////////////////////////////////////////////
+ShellRecorder::ShellRecorder(Stream & conn, Print & aLog)
+    : connection(conn),
+      log(aLog),
+      lastRecordTime(0),
+      pendingTime(0),
+      pendingDirection(0),
+      pendingLength(0)
+{
+}
+
+//////////////////////////////////////////////////////////////////////////////
+void ShellRecorder::begin(void)
+{
+    log.write((const uint8_t *) signature, sizeof(signature) - 1);
+    lastRecordTime = millis();
+    pendingLength = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+void ShellRecorder::record(uint8_t direction, uint8_t aByte)
+{
+    unsigned long now = millis();
+    if (pendingLength > 0
+            && (direction != pendingDirection
+                || now != pendingTime
+                || pendingLength >= MAX_PAYLOAD)) {
+        flushRecord();
+    }
+    if (pendingLength == 0) {
+        pendingDirection = direction;
+        pendingTime = now;
+    }
+    pending[pendingLength++] = aByte;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+void ShellRecorder::flushRecord(void)
+{
+    if (pendingLength == 0) {
+        return;
+    }
+
+    uint8_t header[1 + 5];  // header byte + up to 5 varint bytes
+    int n = 0;
+    header[n++] = pendingDirection | (pendingLength - 1);
+
+    unsigned long delta = pendingTime - lastRecordTime;
+    do {
+        uint8_t b = delta & 0x7f;
+        delta >>= 7;
+        header[n++] = delta ? (b | 0x80) : b;
+    } while (delta);
+
+    log.write(header, n);
+    log.write(pending, pendingLength);
+
+    lastRecordTime = pendingTime;
+    pendingLength = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+size_t ShellRecorder::write(uint8_t aByte)
+{
+    record(OUTPUT_RECORD, aByte);
+    return connection.write(aByte);
+}
+
+int ShellRecorder::availableForWrite()
+{
+    return connection.availableForWrite();
+}
+
+int ShellRecorder::available()
+{
+    return connection.available();
+}
+
+int ShellRecorder::read()
+{
+    int c = connection.read();
+    if (c >= 0) {
+        record(0, c);
+    }
+    return c;
+}
+
+int ShellRecorder::peek()
+{
+    return connection.peek();
+}
+
+void ShellRecorder::flush()
+{
+    flushRecord();
+    log.flush();
+    connection.flush();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+ShellReplayer::ShellReplayer(SimpleSerialShell & aShell, Stream & aLog)
+    : shell(aShell),
+      log(aLog),
+      report(NULL),
+      inputLength(0),
+      inputPos(0),
+      expectedLength(0),
+      expectedPos(0),
+      skipping(0),
+      unexpected(false),
+      waiting(false),
+      nextHeader(-1),
+      nextDelta(0),
+      timed(false),
+      start(0),
+      recordedTime(0),
+      differences(0),
+      inputCount(0),
+      outputCount(0)
+{
+}
+
+//////////////////////////////////////////////////////////////////////////////
+void ShellReplayer::setReport(Print & aReport)
+{
+    report = &aReport;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+int ShellReplayer::run(bool recordedTiming)
+{
+    for (const char * s = signature; *s; s++) {
+        if (log.read() != *s) {
+            return -1;
+        }
+    }
+
+    shell.attach(*this);
+    shell.resetBuffer();
+    differences = 0;
+    inputCount = outputCount = 0;
+    inputLength = inputPos = 0;
+    expectedLength = expectedPos = skipping = 0;
+    unexpected = false;
+    nextHeader = -1;
+    timed = recordedTiming;
+    recordedTime = 0;
+    start = millis();
+
+    for (;;) {
+        if (inputPos < inputLength) {
+            feedInput();
+        } else if (expectedPos < expectedLength) {
+            awaitOutput();
+        } else if (!readRecord()) {
+            break;
+        }
+    }
+
+    // any output left over was not in the recording
+    for (int i = 0; i < IDLE_POLLS; i++) {
+        shell.executeIfInput();
+    }
+    return differences;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+unsigned long ShellReplayer::inputBytes(void) const
+{
+    return inputCount;
+}
+
+unsigned long ShellReplayer::outputBytes(void) const
+{
+    return outputCount;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// the next record's header and delta, into nextHeader and nextDelta
+bool ShellReplayer::readHeader(void)
+{
+    int header = log.read();
+    if (header < 0) {
+        return false;   // end of log
+    }
+
+    unsigned long delta = 0;
+    int shift = 0;
+    int b;
+    do {
+        b = log.read();
+        if (b < 0) {
+            return false;   // truncated log
+        }
+        delta |= (unsigned long)(b & 0x7f) << shift;
+        shift += 7;
+    } while (b & 0x80);
+
+    nextHeader = header;
+    nextDelta = delta;
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// the next record: output is expected next, input is queued for the shell
+// (unless outputOnly: then it stays next)
+bool ShellReplayer::readRecord(bool outputOnly)
+{
+    if (nextHeader < 0 && !readHeader()) {
+        return false;
+    }
+    bool isOutput = (nextHeader & 0x80) != 0;
+    if (outputOnly && !isOutput) {
+        return false;
+    }
+    uint8_t length = (nextHeader & 0x7f) + 1;
+    recordedTime += nextDelta;
+    nextHeader = -1;
+
+    if (isOutput) {
+        expectedLength = log.readBytes((char *) expected, length);
+        expectedPos = 0;
+        return expectedLength == length;
+    }
+
+    // in real time, let the shell idle until the input "arrives"
+    waiting = true;
+    while (timed && (millis() - start) < recordedTime) {
+        shell.executeIfInput();
+    }
+    waiting = false;
+
+    memmove(input, input + inputPos, inputLength - inputPos);
+    inputLength -= inputPos;
+    inputPos = 0;
+    int got = log.readBytes((char *) input + inputLength, length);
+    inputLength += got;
+    return got == length;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// let the shell read its input, and run whatever it completes; give up
+// on input it stops reading (a command that never finishes, say)
+void ShellReplayer::feedInput(void)
+{
+    unsigned long lastRead = millis();
+    while (inputPos < inputLength) {
+        int before = inputPos;
+        shell.executeIfInput();
+        if (inputPos != before) {
+            lastRead = millis();
+        } else if (millis() - lastRead >= STALL_TIMEOUT) {
+            difference(F("input not read"));
+            inputPos = inputLength;
+        }
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// the recording has output next: give the shell a few chances to print it
+void ShellReplayer::awaitOutput(void)
+{
+    for (int i = 0; expectedPos < expectedLength && i < IDLE_POLLS; i++) {
+        shell.executeIfInput();
+    }
+    if (expectedPos < expectedLength) {
+        difference(F("missing output"));
+        expectedPos = expectedLength;   // resynchronize at the next record
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+void ShellReplayer::difference(const __FlashStringHelper * what)
+{
+    differences++;
+    if (report) {
+        report->print(F("replay: "));
+        report->print(what);
+        report->print(F(" after input byte "));
+        report->print(inputCount);
+        report->print(F(", output byte "));
+        report->println(outputCount);
+    }
+}
+
+///////////////////////////////////////////////////////////////
+// Stream interface, as seen by the shell
+//
+size_t ShellReplayer::write(uint8_t aByte)
+{
+    // find the output the recording has next, reading past input (which
+    // the shell gets when it's ready for it) unless that input has a time
+    // to arrive at
+    while (expectedPos == expectedLength && !waiting
+            && inputLength - inputPos <= MAX_PAYLOAD && readRecord(timed)) {
+    }
+
+    if (skipping) {
+        skipping--;
+    } else if (expectedPos == expectedLength) {
+        if (!unexpected) {
+            difference(F("unexpected output"));
+            unexpected = true;
+        }
+    } else if (aByte != expected[expectedPos]) {
+        difference(F("output differs"));
+        // resynchronize at the next record
+        skipping = expectedLength - expectedPos - 1;
+        expectedPos = expectedLength;
+    } else {
+        expectedPos++;
+        outputCount++;
+        unexpected = false;
+    }
+    return 1;
+}
+
+int ShellReplayer::availableForWrite()
+{
+    return MAX_PAYLOAD;     // (compared as it arrives)
+}
+
+int ShellReplayer::available()
+{
+    return inputLength - inputPos;
+}
+
+int ShellReplayer::read()
+{
+    if (available() <= 0) {
+        return -1;
+    }
+    inputCount++;
+    return input[inputPos++];
+}
+
+int ShellReplayer::peek()
+{
+    return available() > 0 ? input[inputPos] : -1;
+}
+
+void ShellReplayer::flush()
+{
+}
@@ -0,0 +1,145 @@
+#ifndef SESSION_RECORDER_H
+#define SESSION_RECORDER_H
+
+#include <Arduino.h>
+#include <SimpleSerialShell.h>
+
+////////////////////////////////////////////////////////////////////////////////
+/*!
+ *  @file SessionRecorder.h
+ *
+ *  Record a console session, and replay it through the shell later.
+ *
+ *  @section format Log format
+ *
+ *  A log starts with the 4 byte signature "SSR1", followed by records:
+ *
+ *      header   1 byte: bit 7 set for shell output, clear for input;
+ *                       bits 0..6 hold (payload length - 1)
+ *      delta    milliseconds since the previous record, as a
+ *               little-endian base-128 varint (1 byte for < 128 ms)
+ *      payload  1..128 bytes, exactly as they crossed the connection
+ *
+ *  Bytes travelling in the same direction within the same millisecond
+ *  share a record, so typical traffic costs 2 bytes of overhead per burst.
+ */
+
+////////////////////////////////////////////////////////////////////////////////
+/*!
+ *  @brief A Stream wrapper that logs everything passing through it.
+ *
+ *  Attach the recorder in place of the real connection:
+ *
+ *      ShellRecorder recorder(Serial, logFile);
+ *      recorder.begin();
+ *      shell.attach(recorder);
+ */
+class ShellRecorder : public Stream {
+    public:
+        ShellRecorder(Stream & connection, Print & log);
+
+        void begin(void);   // writes the log signature
+
+        // Stream interface; reads and writes are passed through and logged
+        virtual size_t write(uint8_t);
+        virtual int availableForWrite();
+        virtual int available();
+        virtual int read();
+        virtual int peek();
+        virtual void flush();   // also completes the pending record
+
+    private:
+        static const uint8_t MAX_PAYLOAD = 128;
+        static const uint8_t OUTPUT_RECORD = 0x80;
+
+        void record(uint8_t direction, uint8_t aByte);
+        void flushRecord(void);
+
+        Stream & connection;
+        Print & log;
+
+        unsigned long lastRecordTime;
+        unsigned long pendingTime;
+        uint8_t pendingDirection;
+        uint8_t pendingLength;
+        uint8_t pending[MAX_PAYLOAD];
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/*!
+ *  @brief Feeds a recorded session back through the shell, and compares
+ *  what the shell prints with what was recorded.
+ *
+ *  The replayer attaches the shell to itself while it runs.  Re-attach
+ *  the real connection afterwards.
+ *
+ *      ShellReplayer replayer(shell, logFile);
+ *      int differences = replayer.run();      // as fast as possible
+ *      int differences = replayer.run(true);  // at recorded timing
+ */
+class ShellReplayer : public Stream {
+    public:
+        ShellReplayer(SimpleSerialShell & shell, Stream & log);
+
+        // Describe each difference found on this stream (optional).
+        void setReport(Print & report);
+
+        // Replays the whole log.  Returns the number of differences
+        // (0 if output matched), or -1 if the log is not a session log.
+        // Input the shell stops reading for a second (behind a command
+        // that never finishes) is a difference too, and is skipped.
+        int run(bool recordedTiming = false);
+
+        unsigned long inputBytes(void) const;   // bytes fed to the shell
+        unsigned long outputBytes(void) const;  // bytes compared
+
+        // Stream interface, as seen by the shell
+        virtual size_t write(uint8_t);
+        virtual int availableForWrite();
+        virtual int available();
+        virtual int read();
+        virtual int peek();
+        virtual void flush();
+
+    private:
+        static const uint8_t MAX_PAYLOAD = 128;
+        static const int IDLE_POLLS = 4;
+        static const unsigned long STALL_TIMEOUT = 1000;    // ms
+
+        bool readHeader(void);
+        bool readRecord(bool outputOnly = false);
+        void feedInput(void);
+        void awaitOutput(void);
+        void difference(const __FlashStringHelper * what);
+
+        SimpleSerialShell & shell;
+        Stream & log;
+        Print * report;
+
+        // recorded input the shell hasn't read yet (reading ahead for
+        // output can queue another record behind it)
+        uint8_t input[2 * MAX_PAYLOAD];
+        int inputLength;
+        int inputPos;
+
+        // the output record the shell's output is compared with, as it
+        // arrives
+        uint8_t expected[MAX_PAYLOAD];
+        uint8_t expectedLength;
+        uint8_t expectedPos;
+        uint8_t skipping;   // output to pass over after a difference
+        bool unexpected;    // output not in the recording, reported
+        bool waiting;       // for recorded timing (no reading ahead)
+
+        int nextHeader;     // of the next record, once read (else -1)
+        unsigned long nextDelta;
+        bool timed;         // at recorded timing: input isn't read ahead
+
+        unsigned long start;
+        unsigned long recordedTime;
+        int differences;
+        unsigned long inputCount;
+        unsigned long outputCount;
+};
+
+#endif /* SESSION_RECORDER_H */
@@ -0,0 +1,213 @@
+#include <Arduino.h>
+#include <SimpleSerialShell.h>
+
+////////////////////////////////////////////////////////////////////////////////
+/*!
+ *  @file ShellBlockTransfer.cpp
+ *
+ *  Binary block transfers of memory, with a window of frames in flight
+ *  (go-back-N); see beginTransfer().
+ *
+ *  The sender reads the memory again to resend, so only one frame is
+ *  ever buffered (in the BlockTransfer).
+ */
+
+static const uint8_t BLOCK_SYNC = 0xB5;
+static const uint8_t ACK = 0x06;
+static const uint8_t NAK = 0x15;
+static const uint8_t CAN = 0x18;
+
+#if SIMPLE_SERIAL_SHELL_BLOCK_SIZE > 250 || SIMPLE_SERIAL_SHELL_BLOCK_WINDOW > 128
+#error "block transfer frames must fit a len byte, and the window half of seq"
+#endif
+
+void SimpleSerialShell::writeRam(unsigned long address, uint8_t value)
+{
+    *(uint8_t *) (uintptr_t) address = value;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void SimpleSerialShell::beginTransfer(BlockTransfer & transfer, unsigned long address,
+                                      unsigned long length)
+{
+    memset(&transfer, 0, sizeof(transfer));
+    transfer.address = address;
+    transfer.length = length;
+    transfer.lastHeard = millis();
+    transferring = true;
+}
+
+int SimpleSerialShell::endTransfer(int result)
+{
+    transferring = false;
+    return result;
+}
+
+// true (once per timeout) when the other end has been quiet too long
+bool SimpleSerialShell::transferTimedOut(BlockTransfer & transfer)
+{
+    if (millis() - transfer.lastHeard < SIMPLE_SERIAL_SHELL_BLOCK_TIMEOUT) {
+        return false;
+    }
+    transfer.lastHeard = millis();
+    transfer.retries++;
+    return true;
+}
+
+void SimpleSerialShell::sendReply(uint8_t reply, unsigned long index)
+{
+    uint8_t bytes[] = { reply, (uint8_t) index };
+    write(bytes, sizeof(bytes));
+}
+
+void SimpleSerialShell::sendFrame(BlockTransfer & transfer, unsigned long index,
+                                  ByteReader reader)
+{
+    unsigned long offset = index * SIMPLE_SERIAL_SHELL_BLOCK_SIZE;
+    unsigned long remaining = transfer.length - offset;
+    uint8_t len = (remaining < SIMPLE_SERIAL_SHELL_BLOCK_SIZE)
+                  ? remaining : SIMPLE_SERIAL_SHELL_BLOCK_SIZE;
+
+    uint8_t * frame = transfer.frame;
+    frame[0] = BLOCK_SYNC;
+    frame[1] = (uint8_t) index;
+    frame[2] = len;
+    for (uint8_t i = 0; i < len; i++) {
+        frame[3 + i] = reader(transfer.address + offset + i);
+    }
+    uint16_t crc = crc16(frame + 1, len + 2);
+    frame[len + 3] = crc & 0xff;
+    frame[len + 4] = crc >> 8;
+    write(frame, len + 5);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int SimpleSerialShell::sendBlocks(BlockTransfer & transfer, ByteReader reader)
+{
+    // the last frame is shorter than the rest (empty if need be)
+    const unsigned long frames = transfer.length / SIMPLE_SERIAL_SHELL_BLOCK_SIZE + 1;
+
+    for (int c; (c = read()) >= 0; ) {
+        if (!transfer.reply) {
+            if (c == CAN) {
+                return endTransfer(CANCELLED);
+            }
+            if (c == ACK || c == NAK) {
+                transfer.reply = c;
+            }
+            continue;   // (anything else is noise)
+        }
+
+        // seq is the low byte of a frame number no lower than acked
+        unsigned long index = transfer.acked + (uint8_t) (c - (uint8_t) transfer.acked);
+        bool heard = true;
+        if (transfer.reply == ACK && index < transfer.sent) {
+            transfer.acked = index + 1;
+        } else if (transfer.reply == NAK && index <= transfer.sent) {
+            transfer.acked = transfer.sent = index;     // go back
+        } else {
+            heard = false;  // not about any frame in flight
+        }
+        if (heard) {
+            transfer.lastHeard = millis();
+            transfer.retries = 0;
+        }
+        transfer.reply = 0;
+    }
+
+    if (transfer.acked == frames) {
+        return endTransfer(EXIT_SUCCESS);
+    }
+    if (transferTimedOut(transfer)) {
+        if (transfer.retries > SIMPLE_SERIAL_SHELL_BLOCK_RETRIES) {
+            write(CAN);
+            return endTransfer(-1);
+        }
+        transfer.sent = transfer.acked;     // (replies may have been lost)
+    }
+
+    while (transfer.sent < frames
+            && transfer.sent - transfer.acked < SIMPLE_SERIAL_SHELL_BLOCK_WINDOW) {
+        // never send part of a frame
+        if (outQueue && outQueueSize - outCount < sizeof(transfer.frame)) {
+            break;
+        }
+        sendFrame(transfer, transfer.sent++, reader);
+    }
+    return PENDING;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int SimpleSerialShell::receiveBlocks(BlockTransfer & transfer, ByteWriter writer)
+{
+    if (transfer.acked == 0 && !transfer.nakked) {
+        sendReply(NAK, 0);  // ready
+        transfer.nakked = true;
+    }
+
+    uint8_t * frame = transfer.frame;
+    for (int c; (c = read()) >= 0; ) {
+        if (transfer.received == 0) {
+            if (c == CAN) {
+                return endTransfer(CANCELLED);
+            }
+            if (c != BLOCK_SYNC) {
+                continue;   // hunting for a frame
+            }
+        }
+        frame[transfer.received++] = c;
+        if (transfer.received == 3 && frame[2] > SIMPLE_SERIAL_SHELL_BLOCK_SIZE) {
+            transfer.received = 0;  // not a frame after all
+            continue;
+        }
+        if (transfer.received < 3 || transfer.received < frame[2] + 5) {
+            continue;
+        }
+        transfer.received = 0;
+
+        // a whole frame
+        uint8_t seq = frame[1];
+        uint8_t len = frame[2];
+        uint16_t crc = crc16(frame + 1, len + 2);
+        bool intact = frame[len + 3] == (crc & 0xff) && frame[len + 4] == (crc >> 8);
+        if (intact && transfer.acked > 0 && seq == (uint8_t) (transfer.acked - 1)) {
+            sendReply(ACK, transfer.acked - 1);     // its ACK was lost
+            continue;
+        }
+
+        unsigned long offset = transfer.acked * SIMPLE_SERIAL_SHELL_BLOCK_SIZE;
+        unsigned long expected = transfer.length - offset;
+        if (expected > SIMPLE_SERIAL_SHELL_BLOCK_SIZE) {
+            expected = SIMPLE_SERIAL_SHELL_BLOCK_SIZE;
+        }
+        if (!intact || seq != (uint8_t) transfer.acked || len != expected) {
+            // ask for it again, once: the frames after it are in flight
+            if (!transfer.nakked) {
+                sendReply(NAK, transfer.acked);
+                transfer.nakked = true;
+            }
+            continue;
+        }
+
+        for (uint8_t i = 0; i < len; i++) {
+            writer(transfer.address + offset + i, frame[3 + i]);
+        }
+        sendReply(ACK, transfer.acked++);
+        transfer.nakked = false;
+        transfer.lastHeard = millis();
+        transfer.retries = 0;
+        if (len < SIMPLE_SERIAL_SHELL_BLOCK_SIZE) {
+            return endTransfer(EXIT_SUCCESS);
+        }
+    }
+
+    if (transferTimedOut(transfer)) {
+        if (transfer.retries > SIMPLE_SERIAL_SHELL_BLOCK_RETRIES) {
+            write(CAN);
+            return endTransfer(-1);
+        }
+        sendReply(NAK, transfer.acked);
+        transfer.nakked = true;
+    }
+    return PENDING;
+}
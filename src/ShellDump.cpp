@@ -0,0 +1,73 @@
+#include <Arduino.h>
+#include <SimpleSerialShell.h>
+
+////////////////////////////////////////////////////////////////////////////////
+/*!
+ *  @file ShellDump.cpp
+ *
+ *  Hex dumps of RAM, PROGMEM, or anything a ByteReader can read.
+ */
+
+static const char hexDigits[] PROGMEM = "0123456789ABCDEF";
+
+static inline char hexDigit(uint8_t nibble)
+{
+    return pgm_read_byte(hexDigits + nibble);
+}
+
+uint8_t SimpleSerialShell::readRam(unsigned long address)
+{
+    return *(const uint8_t *) (uintptr_t) address;
+}
+
+uint8_t SimpleSerialShell::readProgmem(unsigned long address)
+{
+    return pgm_read_byte((const uint8_t *) (uintptr_t) address);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int SimpleSerialShell::dump(ByteReader reader, unsigned long address, unsigned long length)
+{
+    static const uint8_t rowSize = 16;
+    // address, " XX" per byte, ' ', text, CR LF
+    char row[2 * sizeof(address) + rowSize * 4 + 3];
+
+    while (length > 0) {
+        if (cancelRequested()) {
+            return CANCELLED;
+        }
+        uint8_t count = (length < rowSize) ? length : rowSize;
+
+        // the address, without leading zeros
+        char * p = row;
+        uint8_t digits = 1;
+        while (digits < 2 * sizeof(address) && (address >> (4 * digits)) != 0) {
+            digits++;
+        }
+        while (digits--) {
+            *p++ = hexDigit((address >> (4 * digits)) & 0xF);
+        }
+
+        char * text = p + rowSize * 3 + 1;
+        for (uint8_t i = 0; i < rowSize; i++) {
+            *p++ = ' ';
+            if (i < count) {
+                uint8_t b = reader(address + i);
+                *p++ = hexDigit(b >> 4);
+                *p++ = hexDigit(b & 0xF);
+                *text++ = (b >= ' ' && b < 0x7f) ? b : '.';
+            } else {
+                *p++ = ' ';     // (keeps the text lined up)
+                *p++ = ' ';
+            }
+        }
+        *p = ' ';
+        *text++ = '\r';
+        *text++ = '\n';
+        write((const uint8_t *) row, text - row);
+
+        address += count;
+        length -= count;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,99 @@
+#include <Arduino.h>
+#include <SimpleSerialShell.h>
+
+////////////////////////////////////////////////////////////////////////////////
+/*!
+ *  @file ShellFilters.cpp
+ *
+ *  Filters for pipes ("command | filter"); see addFilterCommands().
+ *
+ *  They read their input a bufferful per call, keeping what they need
+ *  between calls.  Only one pipe runs at a time, so that can be static.
+ */
+
+static char grepLine[SIMPLE_SERIAL_SHELL_BUFSIZE];  // (longer lines are cut)
+
+static bool grepMatch(const char * text, size_t length)
+{
+    grepLine[length] = '\0';
+    if (!strstr(grepLine, text)) {
+        return false;
+    }
+    shell.println(grepLine);
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// "grep <text>" prints the lines containing <text>; returns 1 if none do.
+//
+static int grepFilter(int argc, char **argv, SimpleSerialShell::AsyncState & state)
+{
+    if (argc != 2) {
+        shell.println(F("usage: grep <text>"));
+        return -1;
+    }
+    // locals[0]: length of the line so far, locals[1]: lines printed
+    SHELL_ASYNC_BEGIN(state);
+    while (!shell.endOfInput()) {
+        for (int c; (c = shell.read()) >= 0; ) {
+            if (c == '\n') {
+                state.locals[1] += grepMatch(argv[1], state.locals[0]);
+                state.locals[0] = 0;
+            } else if (c != '\r' && state.locals[0] < (long) sizeof(grepLine) - 1) {
+                grepLine[state.locals[0]++] = c;
+            }
+        }
+        SHELL_ASYNC_YIELD(state);   // for more
+    }
+    if (state.locals[0] > 0) {
+        // an unfinished last line
+        state.locals[1] += grepMatch(argv[1], state.locals[0]);
+    }
+    SHELL_ASYNC_END(state);
+
+    return state.locals[1] ? EXIT_SUCCESS : 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// "wc" prints how many lines, words and bytes it was given.
+//
+static struct {
+    unsigned long lines;
+    unsigned long words;
+    unsigned long bytes;
+    bool inWord;
+} wcCounts;
+
+static int wcFilter(int /*argc*/, char ** /*argv*/, SimpleSerialShell::AsyncState & state)
+{
+    SHELL_ASYNC_BEGIN(state);
+    memset(&wcCounts, 0, sizeof(wcCounts));
+    while (!shell.endOfInput()) {
+        for (int c; (c = shell.read()) >= 0; ) {
+            wcCounts.bytes++;
+            if (c == '\n') {
+                wcCounts.lines++;
+            }
+            bool space = isspace(c);
+            if (!space && !wcCounts.inWord) {
+                wcCounts.words++;
+            }
+            wcCounts.inWord = !space;
+        }
+        SHELL_ASYNC_YIELD(state);   // for more
+    }
+    SHELL_ASYNC_END(state);
+
+    shell.print(wcCounts.lines);
+    shell.print(' ');
+    shell.print(wcCounts.words);
+    shell.print(' ');
+    shell.println(wcCounts.bytes);
+    return EXIT_SUCCESS;
+}
+
+void SimpleSerialShell::addFilterCommands(void)
+{
+    addAsyncCommand(F("grep <text>"), grepFilter);
+    addAsyncCommand(F("wc"), wcFilter);
+}
@@ -0,0 +1,92 @@
+#include <Arduino.h>
+#include <SimpleSerialShell.h>
+
+////////////////////////////////////////////////////////////////////////////////
+/*!
+ *  @file ShellLineChecks.cpp
+ *
+ *  Command lines with sequence numbers and CRCs, and status lines with
+ *  CRCs of the responses, for links that can't be trusted; see
+ *  setLineChecks().
+ */
+
+void SimpleSerialShell::setLineChecks(bool on)
+{
+    lineChecks = on;
+    lineSeq = -1;   // (any seq is new)
+    responding = false;
+    responseCrc = 0xFFFF;
+    lastResponseLength = 0;
+}
+
+// the value of exactly digits hex digits at text, or -1
+static long parseHex(const char * text, uint8_t digits)
+{
+    long value = 0;
+    for (uint8_t i = 0; i < digits; i++) {
+        char c = text[i];
+        if (!isxdigit(c)) {
+            return -1;
+        }
+        value = value * 16 + (isdigit(c) ? c - '0' : tolower(c) - 'a' + 10);
+    }
+    return value;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Checks "<seq> <command line>*<crc>" in linebuffer, leaving just the
+// command line if it is to be run; otherwise answers it and clears it.
+//
+bool SimpleSerialShell::checkLine(void)
+{
+    if (linebuffer[0] == '\0') {
+        return false;   // (a blank line)
+    }
+
+    responseCrc = 0xFFFF;   // a new response starts
+    int seq = (linebuffer[2] == ' ') ? parseHex(linebuffer, 2) : -1;
+    char * star = strrchr(linebuffer, '*');
+    bool intact = seq >= 0 && star && strlen(star + 1) == 4
+                  && parseHex(star + 1, 4) == crc16(linebuffer, star - linebuffer);
+
+    if (!intact) {
+        sendLineStatus('-', seq, 0);
+    } else if (seq == lineSeq) {
+        // its response was lost or damaged: send it again, if it was kept
+        if (lastResponseLength <= sizeof(lastResponse)) {
+            responseCrc = crc16(lastResponse, lastResponseLength, responseCrc);
+            write(lastResponse, lastResponseLength);
+            sendLineStatus('+', seq, lineResult);
+        } else {
+            sendLineStatus('!', seq, lineResult);
+        }
+    } else {
+        lineSeq = seq;
+        lastResponseLength = 0;
+        responding = true;      // (everything until its status line)
+        *star = '\0';
+        memmove(linebuffer, linebuffer + 3, star + 1 - (linebuffer + 3));
+        inptr = cursor = strlen(linebuffer);
+        return true;
+    }
+    resetBuffer();
+    return false;
+}
+
+// "+<seq> <result>*<crc>" (or '!') or "-<seq>*<crc>", crc covering the response
+void SimpleSerialShell::sendLineStatus(char status, int seq, int result)
+{
+    // (the CRC covers the status, but it isn't kept with the response)
+    size_t kept = lastResponseLength;
+    responding = true;
+    if (status != '-') {
+        printf(F("%c%02X %d"), status, seq, result);
+    } else if (seq >= 0) {
+        printf(F("-%02X"), seq);
+    } else {
+        print(F("-??"));
+    }
+    responding = false;
+    lastResponseLength = kept;
+    printf(F("*%04X\r\n"), responseCrc);
+}
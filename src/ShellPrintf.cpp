@@ -0,0 +1,258 @@
+#include <Arduino.h>
+#include <SimpleSerialShell.h>
+#include <math.h>
+
+////////////////////////////////////////////////////////////////////////////////
+/*!
+ *  @file ShellPrintf.cpp
+ *
+ *  printf() for the shell: a small formatter for integers, hex, strings
+ *  and fixed-point numbers, writing through one stack buffer.
+ */
+
+////////////////////////////////////////////////////////////////////////////////
+/*!
+ *  @brief printf()'s stack buffer, written out when full (and at the end).
+ */
+struct SimpleSerialShell::FormatBuffer {
+    explicit FormatBuffer(Print & out) : out(out), written(0), used(0) {}
+
+    void put(char c)
+    {
+        if (used == sizeof(text)) {
+            flush();
+        }
+        text[used++] = c;
+    }
+
+    void pad(size_t count, char c)
+    {
+        while (count--) {
+            put(c);
+        }
+    }
+
+    void flush(void)
+    {
+        if (used) {
+            written += out.write((const uint8_t *) text, used);
+            used = 0;
+        }
+    }
+
+    Print & out;
+    size_t written;
+    size_t used;
+    char text[SIMPLE_SERIAL_SHELL_PRINTF_BUFSIZE];
+};
+
+static inline char textChar(const char * p, bool inFlash)
+{
+    return inFlash ? pgm_read_byte(p) : *p;
+}
+
+static size_t textLength(const char * text, bool inFlash, size_t most)
+{
+    size_t length = 0;
+    while (length < most && textChar(text + length, inFlash)) {
+        length++;
+    }
+    return length;
+}
+
+// the digits of value, ending at end; returns where they start
+static char * convert(unsigned long value, uint8_t base, bool upper, char * end)
+{
+    do {
+        uint8_t digit = value % base;
+        *--end = (digit < 10) ? '0' + digit : (upper ? 'A' : 'a') + digit - 10;
+        value /= base;
+    } while (value);
+    return end;
+}
+
+// value with precision digits after the point (like Print::print(double));
+// returns the end of the text
+static char * convertFixed(double value, uint8_t precision, char * text)
+{
+    if (isnan(value)) {
+        return text + strlen(strcpy(text, "nan"));
+    }
+    if (value < 0) {
+        *text++ = '-';
+        value = -value;
+    }
+    if (isinf(value)) {
+        return text + strlen(strcpy(text, "inf"));
+    }
+    double rounding = 0.5;
+    for (uint8_t i = 0; i < precision; i++) {
+        rounding /= 10;
+    }
+    value += rounding;
+    if (value > 4294967040.0) {
+        return text + strlen(strcpy(text, "ovf"));
+    }
+
+    unsigned long whole = (unsigned long) value;
+    double rest = value - whole;
+    char digits[10];
+    char * first = convert(whole, 10, false, digits + sizeof(digits));
+    size_t count = digits + sizeof(digits) - first;
+    memcpy(text, first, count);
+    text += count;
+    if (precision) {
+        *text++ = '.';
+    }
+    while (precision--) {
+        rest *= 10;
+        uint8_t digit = (uint8_t) rest;
+        *text++ = '0' + digit;
+        rest -= digit;
+    }
+    return text;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+size_t SimpleSerialShell::printf(const __FlashStringHelper * format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    size_t n = formatOut((const char *) format, true, args);
+    va_end(args);
+    return n;
+}
+
+size_t SimpleSerialShell::printf(const char * format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    size_t n = formatOut(format, false, args);
+    va_end(args);
+    return n;
+}
+
+size_t SimpleSerialShell::formatOut(const char * format, bool inFlash, va_list args)
+{
+    FormatBuffer out(*this);
+
+    for (char c; (c = textChar(format++, inFlash)) != '\0'; ) {
+        if (c != '%') {
+            out.put(c);
+            continue;
+        }
+
+        bool left = false;
+        bool zeros = false;
+        for (;; format++) {
+            c = textChar(format, inFlash);
+            if (c == '-') {
+                left = true;
+            } else if (c == '0') {
+                zeros = true;
+            } else {
+                break;
+            }
+        }
+        size_t width = 0;
+        for ( ; isdigit(c); c = textChar(++format, inFlash)) {
+            width = width * 10 + c - '0';
+        }
+        int precision = -1;
+        if (c == '.') {
+            precision = 0;
+            while (isdigit(c = textChar(++format, inFlash))) {
+                precision = precision * 10 + c - '0';
+            }
+        }
+        bool isLong = false;
+        for ( ; c == 'l' || c == 'h'; c = textChar(++format, inFlash)) {
+            isLong |= (c == 'l');   // (short arguments arrive as int)
+        }
+        if (c == '\0') {
+            break;  // the format ends mid-conversion
+        }
+        format++;
+
+        // the converted argument: sign, digits, point... up to 21 bytes
+        char digits[24];
+        char * last = digits + sizeof(digits);
+        const char * end = last;
+        const char * text = end;
+        bool flashText = false;
+        bool number = true;
+        switch (c) {
+            case 'd':
+            case 'i': {
+                long value = isLong ? va_arg(args, long) : va_arg(args, int);
+                char * first = convert((value < 0) ? 0UL - (unsigned long) value : value,
+                                       10, false, last);
+                if (value < 0) {
+                    *--first = '-';
+                }
+                text = first;
+                break;
+            }
+            case 'u':
+            case 'x':
+            case 'X': {
+                unsigned long value = isLong ? va_arg(args, unsigned long)
+                                      : va_arg(args, unsigned int);
+                text = convert(value, (c == 'u') ? 10 : 16, c == 'X', last);
+                break;
+            }
+            case 'f':
+                if (precision < 0) {
+                    precision = 6;
+                } else if (precision > 9) {
+                    precision = 9;
+                }
+                text = digits;
+                end = convertFixed(va_arg(args, double), precision, digits);
+                number = isdigit(end[-1]);  // (not "nan", "inf" or "ovf")
+                break;
+            case 's':
+            case 'S':
+                number = false;
+                flashText = (c == 'S');
+                text = va_arg(args, const char *);
+                if (!text) {
+                    text = "(null)";
+                    flashText = false;
+                }
+                end = text + textLength(text, flashText,
+                                        (precision < 0) ? SIZE_MAX : precision);
+                break;
+            case 'c':
+                digits[0] = (char) va_arg(args, int);
+                text = digits;
+                end = digits + 1;
+                number = false;
+                break;
+            default:    // "%%", or a conversion we don't know
+                out.put(c);
+                continue;
+        }
+
+        size_t length = end - text;
+        size_t padding = (width > length) ? width - length : 0;
+        if (!left && zeros && number) {
+            if (*text == '-') {
+                out.put(*text++);   // the sign goes before the zeros
+                length--;
+            }
+            out.pad(padding, '0');
+        } else if (!left) {
+            out.pad(padding, ' ');
+        }
+        while (length--) {
+            out.put(textChar(text++, flashText));
+        }
+        if (left) {
+            out.pad(padding, ' ');
+        }
+    }
+
+    out.flush();
+    return out.written;
+}
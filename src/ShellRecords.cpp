@@ -0,0 +1,174 @@
+#include <Arduino.h>
+#include <SimpleSerialShell.h>
+#include <math.h>
+
+////////////////////////////////////////////////////////////////////////////////
+/*!
+ *  @file ShellRecords.cpp
+ *
+ *  Records of typed fields (see beginRecord()), printed as text for
+ *  people, or as JSON Lines or CSV for host tools.
+ */
+
+static constexpr SimpleSerialShell::Symbol formats[] PROGMEM = {
+    {"csv", SimpleSerialShell::CSV},
+    {"json", SimpleSerialShell::JSON_LINES},
+    {"text", SimpleSerialShell::TEXT},
+};
+static_assert(SimpleSerialShell::symbolsSorted(formats), "formats must be sorted by name");
+
+void SimpleSerialShell::setOutputFormat(OutputFormat format)
+{
+    outputFormat = format;
+}
+
+SimpleSerialShell::OutputFormat SimpleSerialShell::getOutputFormat(void)
+{
+    return outputFormat;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// "format [{csv|json|text}]" sets (or shows) the output format.
+//
+int SimpleSerialShell::formatCommand(int argc, char **argv)
+{
+    int format;
+    if (argc == 1) {
+        shell.println(symbolName(shell.outputFormat, formats));
+        return EXIT_SUCCESS;
+    }
+    if (argc != 2 || !lookupSymbol(argv[1], formats, format)) {
+        shell.print(F("usage: format "));
+        printSymbols(shell, formats);
+        shell.println();
+        return -1;
+    }
+    shell.setOutputFormat((OutputFormat) format);
+    return EXIT_SUCCESS;
+}
+
+void SimpleSerialShell::addFormatCommand(void)
+{
+    addCommand(F("format [{csv|json|text}]"), formatCommand);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void SimpleSerialShell::beginRecord(const __FlashStringHelper * type)
+{
+    recordFields = 0;
+    if (outputFormat == JSON_LINES) {
+        print(F("{\"record\":"));
+        writeString((const char *) type, true);
+    } else if (outputFormat == CSV) {
+        print(type);
+    }
+}
+
+void SimpleSerialShell::endRecord(void)
+{
+    if (outputFormat == JSON_LINES) {
+        print('}');
+    }
+    println();
+}
+
+// what goes before a field's value
+void SimpleSerialShell::fieldKey(const __FlashStringHelper * key)
+{
+    if (outputFormat == JSON_LINES) {
+        print(',');
+        writeString((const char *) key, true);
+        print(':');
+    } else if (outputFormat == CSV) {
+        print(',');
+    } else {
+        printf(recordFields ? F(", %S: ") : F("%S: "), key);
+    }
+    recordFields++;
+}
+
+// a string value: quoted (and escaped) as the format needs
+void SimpleSerialShell::writeString(const char * text, bool inFlash)
+{
+    const char * p;
+    char c;
+    if (outputFormat == JSON_LINES) {
+        print('"');
+        for (p = text; (c = inFlash ? pgm_read_byte(p) : *p) != '\0'; p++) {
+            if (c == '"' || c == '\\') {
+                print('\\');
+                print(c);
+            } else if ((uint8_t) c < ' ') {
+                printf(F("\\u%04x"), c);
+            } else {
+                print(c);
+            }
+        }
+        print('"');
+        return;
+    }
+
+    bool quoted = false;
+    if (outputFormat == CSV) {
+        for (p = text; (c = inFlash ? pgm_read_byte(p) : *p) != '\0'; p++) {
+            quoted |= (c == ',' || c == '"' || c == '\r' || c == '\n');
+        }
+    }
+    if (quoted) {
+        print('"');
+    }
+    for (p = text; (c = inFlash ? pgm_read_byte(p) : *p) != '\0'; p++) {
+        if (quoted && c == '"') {
+            print(c);   // (doubled)
+        }
+        print(c);
+    }
+    if (quoted) {
+        print('"');
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void SimpleSerialShell::field(const __FlashStringHelper * key, long value)
+{
+    fieldKey(key);
+    printf(F("%ld"), value);
+}
+
+void SimpleSerialShell::field(const __FlashStringHelper * key, unsigned long value)
+{
+    fieldKey(key);
+    printf(F("%lu"), value);
+}
+
+void SimpleSerialShell::field(const __FlashStringHelper * key, double value, uint8_t digits)
+{
+    fieldKey(key);
+    if (outputFormat != TEXT && (isnan(value) || isinf(value) || fabs(value) > 4294967040.0)) {
+        // (no number to give)
+        if (outputFormat == JSON_LINES) {
+            print(F("null"));
+        }
+        return;
+    }
+    print(value, digits);
+}
+
+void SimpleSerialShell::field(const __FlashStringHelper * key, bool value)
+{
+    fieldKey(key);
+    print(value ? F("true") : F("false"));
+}
+
+void SimpleSerialShell::field(const __FlashStringHelper * key, const char * value)
+{
+    fieldKey(key);
+    writeString(value, false);
+}
+
+void SimpleSerialShell::field(const __FlashStringHelper * key,
+                              const __FlashStringHelper * value)
+{
+    fieldKey(key);
+    writeString((const char *) value, true);
+}
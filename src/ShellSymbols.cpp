@@ -0,0 +1,63 @@
+#include <Arduino.h>
+#include <SimpleSerialShell.h>
+
+////////////////////////////////////////////////////////////////////////////////
+/*!
+ *  @file ShellSymbols.cpp
+ *
+ *  Symbol tables: constant name <-> value pairs kept in flash.
+ *  Names are read in place, so nothing is copied to RAM.
+ */
+
+////////////////////////////////////////////////////////////////////////////////
+// binary search: the names are sorted (checked with symbolsSorted())
+//
+bool SimpleSerialShell::lookupSymbol(const char * name, const Symbol table[],
+                                     size_t count, int & value)
+{
+    size_t low = 0;
+    size_t high = count;
+    while (low < high) {
+        size_t middle = (low + high) / 2;
+        int order = strcasecmp_P(name, table[middle].name);
+        if (order == 0) {
+            memcpy_P(&value, &table[middle].value, sizeof(value));
+            return true;
+        }
+        if (order < 0) {
+            high = middle;
+        } else {
+            low = middle + 1;
+        }
+    }
+    return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// (values aren't sorted; tables are short)
+//
+const __FlashStringHelper * SimpleSerialShell::symbolName(int value,
+        const Symbol table[], size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        int aValue;
+        memcpy_P(&aValue, &table[i].value, sizeof(aValue));
+        if (aValue == value) {
+            return (const __FlashStringHelper *) table[i].name;
+        }
+    }
+    return NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void SimpleSerialShell::printSymbols(Print & out, const Symbol table[], size_t count)
+{
+    out.print('{');
+    for (size_t i = 0; i < count; i++) {
+        if (i > 0) {
+            out.print('|');
+        }
+        out.print((const __FlashStringHelper *) table[i].name);
+    }
+    out.print('}');
+}
@@ -19,6 +19,13 @@ SimpleSerialShell& shell = SimpleSerialShell::theShell;
 
 //
 SimpleSerialShell::Command * SimpleSerialShell::firstCommand = NULL;
+SimpleSerialShell::Command * SimpleSerialShell::freeCommands = NULL;
+
+const int SimpleSerialShell::PENDING;
+const int SimpleSerialShell::CANCELLED;
+
+#define CTRL_C 0x03
+#define ESC 0x1b
 
 ////////////////////////////////////////////////////////////////////////////////
 /*!
@@ -27,81 +34,312 @@ SimpleSerialShell::Command * SimpleSerialShell::firstCommand = NULL;
 class SimpleSerialShell::Command {
     public:
         Command(const __FlashStringHelper * n, CommandFunction f):
-            nameAndDocs(n), myFunc(f) {};
+            nameAndDocs(n), kind(SYNC), removed(false), context(NULL)
+        {
+            myFunc.sync = f;
+        };
+
+        Command(const __FlashStringHelper * n, AsyncCommandFunction f):
+            nameAndDocs(n), kind(ASYNC), removed(false), context(NULL)
+        {
+            myFunc.async = f;
+        };
+
+        Command(const __FlashStringHelper * n, ContextCommandFunction f, void * c):
+            nameAndDocs(n), kind(CONTEXT), removed(false), context(c)
+        {
+            myFunc.withContext = f;
+        };
+
+        // a group of commands (initially empty)
+        explicit Command(const __FlashStringHelper * n):
+            nameAndDocs(n), kind(GROUP), removed(false), context(NULL)
+        {
+            myFunc.children = NULL;
+        };
 
-        int execute(int argc, char **argv)
+        // runs (or resumes) the command
+        int execute(int argc, char **argv, AsyncState & state)
         {
-            return myFunc(argc, argv);
+            int result;
+            switch (kind) {
+                case ASYNC:
+                    return myFunc.async(argc, argv, state);
+                case GROUP:
+                    // (reached when no command in it was named)
+                    return listGroup(this, argc, argv);
+                case CONTEXT:
+                    result = myFunc.withContext(argc, argv, context);
+                    break;
+                default:
+                    result = myFunc.sync(argc, argv);
+                    break;
+            }
+            // (only an asynchronous command can be resumed)
+            return (result == PENDING) ? -1 : result;
         };
 
         // Comparison used for sort commands
         int compare(const Command * other) const
         {
-            const String otherNameString(other->nameAndDocs);
-            return compareName(otherNameString.c_str());
+            return compareNames(nameAndDocs, (const char *) other->nameAndDocs, true);
         };
 
         int compareName(const char * aName) const
         {
-            // Look for the command delimiter and make sure we don't
-            // consider anything beyond it in the comparison.  There
-            // may be more documentation in the string.
-            //
-            // Note for future consideration: The temporary String here could
-            // be eliminated here by leveraging strlen_P, pgm_read_byte, and
-            // strncasecmp_P.  That will take a bit of research since
-            // the header file may have a different name on ESP2886/ESP32.
-            String work(nameAndDocs);
-            int delim = work.indexOf(' ');
-            if (delim >= 0) {
-                work.remove(delim);
-            }
-            return strncasecmp(work.c_str(), aName, SIMPLE_SERIAL_SHELL_BUFSIZE);
+            return compareNames(nameAndDocs, aName, false);
+        };
+
+        // like compareName(), but only the first strlen(prefix)
+        // characters of the name have to match
+        int comparePrefix(const char * prefix) const
+        {
+            return compareNames(nameAndDocs, prefix, false, true);
         };
 
         /**
          * @brief Writes the documentation associated with this command.
          *
          * @param str Stream to write into.
+         * @param dictionary Expands compressed documentation (or NULL).
          */
-        void renderDocumentation(Stream& str) const
+        void renderDocumentation(Print& str, const char * dictionary,
+                                 const Command * group = NULL) const
         {
             str.print(F("  "));
-            str.print(nameAndDocs);
+            if (group) {
+                group->renderName(str);
+                str.print(' ');
+            }
+            if (!dictionary) {
+                str.print(nameAndDocs);
+            } else {
+                // stream it out, expanding dictionary references as we go
+                const char * p = (const char *) nameAndDocs;
+                for (uint8_t c; (c = pgm_read_byte(p)) != 0; p++) {
+                    if (c & 0x80) {
+                        writeDictionaryEntry(str, dictionary, c & 0x7f);
+                    } else {
+                        str.write(c);
+                    }
+                }
+            }
             str.println();
         }
 
+        // the name alone (names are never compressed)
+        void renderName(Print& str) const
+        {
+            const char * p = (const char *) nameAndDocs;
+            for (char c; (c = pgm_read_byte(p)) != 0 && c != ' '; p++) {
+                str.print(c);
+            }
+        }
+
+        bool isAsynchronous(void) const
+        {
+            return kind == ASYNC;
+        }
+
+        bool isGroup(void) const
+        {
+            return kind == GROUP;
+        }
+
+        // removed, but maybe still running (see retireCommand())
+        bool isRemoved(void) const
+        {
+            return removed;
+        }
+
+        void markRemoved(void)
+        {
+            removed = true;
+        }
+
+        // a group's commands, sorted like the top-level list
+        Command *& children(void)
+        {
+            return myFunc.children;
+        }
+
         Command * next;
 
     private:
 
-        const __FlashStringHelper * const nameAndDocs;
-        const CommandFunction myFunc;
+        // Dictionary entries are packed in flash as <length><text>...,
+        // ending with a zero length.
+        static void writeDictionaryEntry(Print& str, const char * dictionary,
+                                         uint8_t index)
+        {
+            uint8_t len;
+            while ((len = pgm_read_byte(dictionary)) != 0) {
+                if (index-- == 0) {
+                    while (len--) {
+                        str.write(pgm_read_byte(++dictionary));
+                    }
+                    return;
+                }
+                dictionary += len + 1;
+            }
+        }
+
+        // Compare command names without building temporary Strings.
+        // A name ends at the first space (documentation may follow).
+        static int compareNames(const __FlashStringHelper * flashName,
+                                const char * other, bool otherInFlash,
+                                bool prefixOnly = false)
+        {
+            const char * p = (const char *) flashName;
+            for (;; p++, other++) {
+                char a = pgm_read_byte(p);
+                char b = otherInFlash ? pgm_read_byte(other) : *other;
+                a = (a == ' ') ? '\0' : tolower(a);
+                b = (b == ' ') ? '\0' : tolower(b);
+                if (prefixOnly && b == '\0') {
+                    return 0;
+                }
+                if (a != b || a == '\0') {
+                    return a - b;
+                }
+            }
+        }
+
+        // (not const: a removed command's storage is reused)
+        const __FlashStringHelper * nameAndDocs;
+        enum Kind { SYNC, ASYNC, GROUP, CONTEXT };
+        uint8_t kind : 2;
+        bool removed : 1;
+        union {
+            CommandFunction sync;
+            AsyncCommandFunction async;
+            ContextCommandFunction withContext;
+            Command * children;
+        } myFunc;
+        void * context;     // for withContext
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/*!
+ *  @brief "command | filter" while it runs (on runPipe()'s stack).
+ */
+struct SimpleSerialShell::Pipe {
+    Command * filter;
+    int argc;
+    char ** argv;
+    AsyncState state;   // the filter's
+    int result;         // the filter's last result
+    bool filtering;     // the filter is running, reading the buffer
+    bool ended;         // the command has finished
+    bool done;          // the filter has finished; drop further output
+    size_t length;      // bytes in buffer
+    size_t readPos;     // next byte for the filter
+    uint8_t buffer[SIMPLE_SERIAL_SHELL_PIPE_BUFSIZE];
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/*!
+ *  @brief capture()'s buffer while its command runs.
+ */
+struct SimpleSerialShell::Capture {
+    char * buffer;
+    size_t size;
+    size_t length;      // bytes printed (may be more than were kept)
 };
 
 ////////////////////////////////////////////////////////////////////////////////
 SimpleSerialShell::SimpleSerialShell()
     : shellConnection(NULL),
       m_lastErrNo(EXIT_SUCCESS),
-      tokenizer(strtok_r)
+      commandsRemoved(false),
+      tokenizer(strtok_r),
+      helpDictionary(NULL),
+      asyncCommand(NULL),
+      asyncArgc(0),
+      asyncArgsHeld(0),
+      running(0),
+      cancelled(false),
+      pipe(NULL),
+      capturing(NULL),
+      outputFormat(TEXT),
+      recordFields(0),
+      muted(false),
+      lineChecks(false),
+      lineSeq(-1),
+      lineResult(0),
+      responding(false),
+      responseCrc(0xFFFF),
+      lastResponseLength(0),
+      transferring(false),
+      jobs(NULL),
+      maxJobs(0),
+      activeJobs(0),
+      lastJobId(0),
+      subscriptions(NULL),
+      maxSubscriptions(0),
+      lastSubscriptionId(0),
+      aliasArena(NULL),
+      aliasArenaSize(0),
+      aliasUsed(0),
+      history(NULL),
+      historySize(0),
+      historyStart(0),
+      historyUsed(0),
+      historyRecall(0),
+      escape(0),
+      lineArenaUsed(0),
+      outQueue(NULL),
+      outQueueSize(0),
+      outHead(0),
+      outCount(0),
+      outDropped(0),
+      stallStart(0),
+      stallMillis(0)
 {
     resetBuffer();
 
     // simple help.
-    addCommand(F("help"), SimpleSerialShell::printHelp);
+    addAsyncCommand(F("help"), SimpleSerialShell::renderHelp);
 };
 
 //////////////////////////////////////////////////////////////////////////////
 void SimpleSerialShell::addCommand(
-    const __FlashStringHelper * name, CommandFunction f)
+    const __FlashStringHelper * name, CommandFunction f, Command * group)
+{
+    insertCommand(allocateCommand(Command(name, f)), group);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+void SimpleSerialShell::addCommand(const __FlashStringHelper * name,
+                                   ContextCommandFunction f, void * context, Command * group)
+{
+    insertCommand(allocateCommand(Command(name, f, context)), group);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+void SimpleSerialShell::addAsyncCommand(
+    const __FlashStringHelper * name, AsyncCommandFunction f, Command * group)
+{
+    insertCommand(allocateCommand(Command(name, f)), group);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+SimpleSerialShell::Command * SimpleSerialShell::addCommandGroup(
+    const __FlashStringHelper * name, Command * group)
 {
-    auto * newCmd = new Command(name, f);
+    Command * newGroup = allocateCommand(Command(name));
+    insertCommand(newGroup, group);
+    return newGroup;
+}
 
+//////////////////////////////////////////////////////////////////////////////
+void SimpleSerialShell::insertCommand(Command * newCmd, Command * group)
+{
     // insert in list alphabetically
     // from stackoverflow...
 
-    Command* temp2 = firstCommand;
-    Command** temp3 = &firstCommand;
+    Command** temp3 = group ? &group->children() : &firstCommand;
+    Command* temp2 = *temp3;
     while (temp2 != NULL && (newCmd->compare(temp2) > 0) )
     {
         temp3 = &temp2->next;
@@ -111,21 +349,161 @@ void SimpleSerialShell::addCommand(
     newCmd->next = temp2;
 }
 
+//////////////////////////////////////////////////////////////////////////////
+// a node for a new command: a reclaimed one if there is one
+//
+SimpleSerialShell::Command * SimpleSerialShell::allocateCommand(const Command & prototype)
+{
+    Command * aCmd = freeCommands;
+    if (!aCmd) {
+        return new Command(prototype);
+    }
+    freeCommands = aCmd->next;
+    *aCmd = prototype;
+    return aCmd;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+bool SimpleSerialShell::removeCommand(const char * name, Command * group)
+{
+    Command * aCmd = findCommand(name, group ? group->children() : firstCommand);
+    if (!aCmd) {
+        return false;
+    }
+    retireCommand(aCmd, NULL);
+    reclaimCommands();
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+void SimpleSerialShell::replaceCommand(
+    const __FlashStringHelper * name, CommandFunction f, Command * group)
+{
+    Command * newCmd = allocateCommand(Command(name, f));
+    Command * oldCmd = group ? group->children() : firstCommand;
+    while (oldCmd && (oldCmd->isRemoved() || newCmd->compare(oldCmd) != 0)) {
+        oldCmd = oldCmd->next;
+    }
+    insertCommand(newCmd, group);   // (ahead of the old one)
+    if (oldCmd) {
+        retireCommand(oldCmd, newCmd);
+        reclaimCommands();
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Take a command out of service.  It stays in its list (skipped by lookups)
+// until reclaimCommands(), since it, or "help" walking the list, may still
+// be running; jobs and aliases switch to the replacement (or drop it).
+//
+void SimpleSerialShell::retireCommand(Command * aCmd, Command * replacement)
+{
+    aCmd->markRemoved();
+    commandsRemoved = true;
+
+    if (aCmd->isGroup()) {
+        for (Command * member = aCmd->children(); member; member = member->next) {
+            if (!member->isRemoved()) {
+                retireCommand(member, NULL);
+            }
+        }
+    }
+
+    for (uint8_t i = 0; i < activeJobs; ) {
+        if (jobs[i].command != aCmd) {
+            i++;
+        } else if (replacement) {
+            jobs[i++].command = replacement;
+        } else {
+            removeJob(i);
+            i = 0;  // (the heap was reordered; start over)
+        }
+    }
+    if (aliasArena) {
+        retargetAliases(aCmd, replacement);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// move removed commands to the free list, once none can be running
+//
+void SimpleSerialShell::reclaimCommands(void)
+{
+    if (commandsRemoved && !running && !asyncCommand) {
+        sweepCommands(&firstCommand);
+        commandsRemoved = false;
+    }
+}
+
+void SimpleSerialShell::sweepCommands(Command ** list)
+{
+    while (*list) {
+        Command * aCmd = *list;
+        if (aCmd->isGroup()) {
+            sweepCommands(&aCmd->children());
+        }
+        if (aCmd->isRemoved()) {
+            *list = aCmd->next;
+            aCmd->next = freeCommands;
+            freeCommands = aCmd;
+        } else {
+            list = &aCmd->next;
+        }
+    }
+}
+
 //////////////////////////////////////////////////////////////////////////////
 bool SimpleSerialShell::executeIfInput(void)
 {
+    reclaimCommands();
+    drainOutput();
+    if (!transferring) {
+        // (nothing else may write in the middle of binary frames; and this
+        // isn't part of any line's response)
+        bool wasResponding = responding;
+        responding = false;
+        runDueJobs();
+        sendTelemetry();
+        responding = wasResponding;
+    }
+
+    if (asyncCommand) {
+        // an earlier command is still running; no new input until it's done
+        if (resumeAsync()) {
+            commandDone();
+        }
+        return true;
+    }
+
     bool bufferReady = prepInput();
     bool didSomething = false;
 
     if (bufferReady) {
         didSomething = true;
-        execute();
-	print(F("> ")); // provide command prompt feedback
+        if (!lineChecks || checkLine()) {
+            execute();
+            if (!asyncCommand) {
+                commandDone();
+            }
+        }
     }
 
     return didSomething;
 }
 
+//////////////////////////////////////////////////////////////////////////////
+// after a command typed at the shell: the prompt, or its status line
+//
+void SimpleSerialShell::commandDone(void)
+{
+    if (lineChecks) {
+        lineResult = m_lastErrNo;
+        sendLineStatus('+', lineSeq, lineResult);
+    } else if (outputFormat == TEXT) {
+        print(F("> ")); // provide command prompt feedback
+    }
+}
+
 //////////////////////////////////////////////////////////////////////////////
 void SimpleSerialShell::attach(Stream & requester)
 {
@@ -142,9 +520,27 @@ bool SimpleSerialShell::prepInput(void)
 {
     bool bufferReady = false; // assume not ready
     bool moreData = true;
+    muted = (outputFormat != TEXT || lineChecks);   // hosts don't want their input echoed
 
     do {
         int c = read();
+
+        if (escape != 0 && c >= 0) {
+            // inside an ANSI escape sequence (arrow keys send ESC [ A..D)
+            if (escape == ESC && (c == '[' || c == 'O')) {
+                escape = c;
+                continue;
+            } else if (escape != ESC && (c < 0x40 || c > 0x7e)) {
+                // parameter bytes; wait for the final byte
+                continue;
+            } else if (escape != ESC) {
+                arrowKey(c);
+                escape = 0;
+                continue;
+            }
+            escape = 0;     // not a sequence after all; c is typed as usual
+        }
+
         switch (c)
         {
             case -1: // No character present; don't do anything.
@@ -153,13 +549,25 @@ bool SimpleSerialShell::prepInput(void)
             case  0: // throw away NUL characters
                 break;
 
+            case ESC:
+                escape = ESC;
+                break;
+
             // Line editing characters
             case 127: // DEL delete key
             case '\b':  // CTRL(H) backspace
-                // Destructive backspace: remove last character
-                if (inptr > 0) {
+                // Destructive backspace: remove character before the cursor
+                if (cursor == inptr && inptr > 0) {
                     print(F("\b \b"));  // remove char in raw UI
                     linebuffer[--inptr] = 0;
+                    cursor = inptr;
+                } else if (cursor > 0) {
+                    memmove(linebuffer + cursor - 1, linebuffer + cursor, inptr - cursor + 1);
+                    inptr--;
+                    write('\b');
+                    moveCursor(--cursor, inptr);
+                    print(' ');
+                    moveCursor(inptr + 1, cursor);
                 }
                 break;
 
@@ -167,6 +575,13 @@ bool SimpleSerialShell::prepInput(void)
                 //Ctrl-R retypes the line
                 print(F("\r\n"));
                 print(linebuffer);
+                cursor = inptr;
+                break;
+
+            case CTRL_C:
+                //Ctrl-C abandons the line (nothing is running).
+                println(F("^C"));
+                resetBuffer();
                 break;
 
             case 0x15: //CTRL('U')
@@ -182,6 +597,7 @@ bool SimpleSerialShell::prepInput(void)
                 // raw input only sends "return" for the keypress
                 // line is complete
                 println();     // Echo newline too.
+                remember();
                 bufferReady = true;
                 break;
 
@@ -191,43 +607,219 @@ bool SimpleSerialShell::prepInput(void)
                 break;
 
             default:
-                // Otherwise, echo the character and append it to the buffer
-                linebuffer[inptr++] = c;
-                write(c);
-                if (inptr >= SIMPLE_SERIAL_SHELL_BUFSIZE-1) {
-                    bufferReady = true; // flush to avoid overflow
+                // Otherwise, echo the character and add it to the buffer
+                if (cursor == inptr) {
+                    linebuffer[inptr++] = c;
+                    cursor = inptr;
+                    write(c);
+                    if (inptr >= SIMPLE_SERIAL_SHELL_BUFSIZE-1) {
+                        bufferReady = true; // flush to avoid overflow
+                    }
+                } else if (inptr < SIMPLE_SERIAL_SHELL_BUFSIZE-1) {
+                    // insert, and redraw the rest of the line
+                    memmove(linebuffer + cursor + 1, linebuffer + cursor, inptr - cursor + 1);
+                    linebuffer[cursor] = c;
+                    inptr++;
+                    moveCursor(cursor, inptr);
+                    moveCursor(inptr, ++cursor);
                 }
                 break;
         }
     } while (moreData && !bufferReady);
 
+    muted = false;
     return bufferReady;
 }
 
+//////////////////////////////////////////////////////////////////////////////
+// Moves the terminal cursor from column "from" to column "to" of the line
+// being edited, with as few bytes as possible: going right re-writes the
+// characters in between; going left uses backspaces, or ESC [ <n> D when
+// that is shorter.
+void SimpleSerialShell::moveCursor(int from, int to)
+{
+    if (to > from) {
+        write((const uint8_t *) linebuffer + from, to - from);
+    } else if (from - to > 4) {
+        print(F("\x1b["));
+        print(from - to);
+        print('D');
+    } else {
+        for ( ; from > to; from--) {
+            write('\b');
+        }
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// the final byte of ESC [ <final>
+void SimpleSerialShell::arrowKey(int c)
+{
+    switch (c) {
+        case 'A':   // up: an older line
+            recallHistory(historyRecall + 1);
+            break;
+        case 'B':   // down: a newer line
+            if (historyRecall > 0) {
+                recallHistory(historyRecall - 1);
+            }
+            break;
+        case 'C':   // right
+            if (cursor < inptr) {
+                moveCursor(cursor, cursor + 1);
+                cursor++;
+            }
+            break;
+        case 'D':   // left
+            if (cursor > 0) {
+                moveCursor(cursor, cursor - 1);
+                cursor--;
+            }
+            break;
+        default:    // (other keys are ignored)
+            break;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Command history: lines are kept back to back (each ending with a NUL)
+// in a ring of bytes; the oldest are dropped to make room.
+//
+void SimpleSerialShell::setHistory(char * buffer, size_t size)
+{
+    history = buffer;
+    historySize = buffer ? size : 0;
+    historyStart = historyUsed = 0;
+    historyRecall = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// copies history line n (1 is the newest) into linebuffer
+bool SimpleSerialShell::historyLine(int n, char * line)
+{
+    if (n <= 0 || historyUsed == 0) {
+        return false;
+    }
+    // walk back from the NUL at the end of the newest line
+    size_t end = historyUsed - 1;   // (relative to historyStart)
+    for (;;) {
+        size_t start = end;
+        while (start > 0 && history[(historyStart + start - 1) % historySize] != '\0') {
+            start--;
+        }
+        if (--n == 0) {
+            for (size_t i = start; i <= end; i++) {
+                *line++ = history[(historyStart + i) % historySize];
+            }
+            return true;
+        }
+        if (start == 0) {
+            return false;   // there are fewer lines than that
+        }
+        end = start - 1;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// replaces the line being edited with history line n (0: an empty line),
+// redrawing only what changed
+void SimpleSerialShell::recallHistory(int n)
+{
+    char recalled[SIMPLE_SERIAL_SHELL_BUFSIZE];
+    if (n == 0) {
+        recalled[0] = '\0';
+    } else if (!historyLine(n, recalled)) {
+        return;
+    }
+    historyRecall = n;
+
+    int same = 0;
+    while (same < inptr && linebuffer[same] == recalled[same]) {
+        same++;
+    }
+    int keep = (cursor < same) ? cursor : same;  // what stays on screen
+    moveCursor(cursor, keep);
+    int oldLength = inptr;
+    strcpy(linebuffer, recalled);
+    inptr = strlen(linebuffer);
+    moveCursor(keep, inptr);
+    if (inptr < oldLength) {
+        print(F("\x1b[K"));    // erase the rest of the old line
+    }
+    cursor = inptr;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// adds the completed line to the history (unless it's empty, or a repeat)
+void SimpleSerialShell::remember(void)
+{
+    historyRecall = 0;
+    size_t length = inptr + 1;
+    if (inptr == 0 || length > historySize) {
+        return;
+    }
+    char newest[SIMPLE_SERIAL_SHELL_BUFSIZE];
+    if (historyLine(1, newest) && strcmp(newest, linebuffer) == 0) {
+        return;
+    }
+
+    // drop the oldest lines until it fits
+    while (historyUsed + length > historySize) {
+        while (history[historyStart] != '\0') {
+            historyStart = (historyStart + 1) % historySize;
+            historyUsed--;
+        }
+        historyStart = (historyStart + 1) % historySize;
+        historyUsed--;
+    }
+    for (size_t i = 0; i < length; i++) {
+        history[(historyStart + historyUsed++) % historySize] = linebuffer[i];
+    }
+}
+
 //////////////////////////////////////////////////////////////////////////////
 int SimpleSerialShell::execute(const char commandString[])
 {
-    // overwrites anything in linebuffer; hope you don't need it!
-    strncpy(linebuffer, commandString, SIMPLE_SERIAL_SHELL_BUFSIZE);
-    return execute();
+    // Work on a copy, leaving anything being typed in linebuffer (or the
+    // arguments of a command that runs this one) alone.  Copies stack up
+    // in lineArena, taking only the room they need.
+    size_t length = strlen(commandString) + 1;
+    if (length > SIMPLE_SERIAL_SHELL_BUFSIZE) {
+        length = SIMPLE_SERIAL_SHELL_BUFSIZE;   // (truncated, as typed lines are)
+    }
+    if (lineArenaUsed + length > sizeof(lineArena)) {
+        return report(F("line too long for nesting"), -1);
+    }
+    char * line = lineArena + lineArenaUsed;
+    memcpy(line, commandString, length - 1);
+    line[length - 1] = '\0';
+    lineArenaUsed += length;
+
+    int result = executeInPlace(line);
+    if (asyncCommand && asyncArgv[0] >= line && asyncArgv[0] < line + length) {
+        // an asynchronous command needs its arguments after we return:
+        // the copy stays in lineArena until resumeAsync() is done with it
+        asyncArgsHeld = length;
+    } else {
+        lineArenaUsed -= length;
+    }
+    return result;
 }
 
 //////////////////////////////////////////////////////////////////////////////
-int SimpleSerialShell::execute(void)
+int SimpleSerialShell::executeInPlace(char * line)
 {
     char * argv[MAXARGS] = {0};
-    linebuffer[SIMPLE_SERIAL_SHELL_BUFSIZE - 1] = '\0'; // play it safe
     int argc = 0;
 
     char * rest = NULL;
     const char * whitespace = " \t\r\n"; // not PROGMEM/simple TokenizerFunction
-    char * commandName = tokenizer(linebuffer, whitespace, &rest);
+    char * commandName = tokenizer(line, whitespace, &rest);
 
     if (!commandName)
     {
         // empty line; no arguments found.
         println(F("OK"));
-        resetBuffer();
         return EXIT_SUCCESS;
     }
     argv[argc++] = commandName;
@@ -247,97 +839,1179 @@ int SimpleSerialShell::execute(void)
 }
 
 //////////////////////////////////////////////////////////////////////////////
-int SimpleSerialShell::execute(int argc, char **argv)
+// run the line typed into linebuffer
+int SimpleSerialShell::execute(void)
 {
-    m_lastErrNo = 0;
-    for ( Command * aCmd = firstCommand; aCmd != NULL; aCmd = aCmd->next) {
-        if (aCmd->compareName(argv[0]) == 0) {
-            m_lastErrNo = aCmd->execute(argc, argv);
-            resetBuffer();
-            return m_lastErrNo;
-        }
+    linebuffer[SIMPLE_SERIAL_SHELL_BUFSIZE - 1] = '\0'; // play it safe
+    int result = executeInPlace(linebuffer);
+    if (!asyncCommand) {
+        resetBuffer();  // (else its arguments are still in linebuffer)
     }
-    print(F("\""));
-    print(argv[0]);
-    print(F("\": "));
-
-    return report(F("command not found"), -1);
+    return result;
 }
 
 //////////////////////////////////////////////////////////////////////////////
-int SimpleSerialShell::lastErrNo(void)
+SimpleSerialShell::Command * SimpleSerialShell::findCommand(const char * name, Command * list)
 {
-    return m_lastErrNo;
+    for ( Command * aCmd = list; aCmd != NULL; aCmd = aCmd->next) {
+        int order = aCmd->compareName(name);
+        if (order == 0 && !aCmd->isRemoved()) {
+            return aCmd;
+        }
+        if (order > 0) {
+            break;  // sorted; it is not further on
+        }
+    }
+    return NULL;
 }
 
 //////////////////////////////////////////////////////////////////////////////
-int SimpleSerialShell::report(const __FlashStringHelper * constMsg, int errorCode)
+// find the command argv names, following groups ("gpio read 5" is gpio's
+// "read 5"); argc and argv are left at the command found
+//
+SimpleSerialShell::Command * SimpleSerialShell::resolveCommand(int & argc, char **& argv)
 {
-    if (errorCode != EXIT_SUCCESS)
-    {
-        String message(constMsg);
-        print(errorCode);
-        if (message[0] != '\0') {
-            print(F(": "));
-            println(message);
+    Command * aCmd = findCommand(argv[0]);
+    while (aCmd && aCmd->isGroup() && argc > 1) {
+        Command * member = findCommand(argv[1], aCmd->children());
+        if (!member) {
+            break;
         }
+        aCmd = member;
+        argc--;
+        argv++;
     }
-    resetBuffer();
-    m_lastErrNo = errorCode;
-    return errorCode;
+    return aCmd;
 }
+
 //////////////////////////////////////////////////////////////////////////////
-void SimpleSerialShell::resetBuffer(void)
+// a group run without naming one of its commands
+//
+int SimpleSerialShell::listGroup(const Command * group, int argc, char **argv)
 {
-    memset(linebuffer, 0, sizeof(linebuffer));
-    inptr = 0;
+    if (argc > 1) {
+        return shell.report(argv[1], F("command not found"), -1);
+    }
+    for (Command * aCmd = ((Command *) group)->children(); aCmd; aCmd = aCmd->next) {
+        if (!aCmd->isRemoved()) {
+            aCmd->renderDocumentation(shell, shell.helpDictionary, group);
+        }
+    }
+    return EXIT_SUCCESS;
 }
 
 //////////////////////////////////////////////////////////////////////////////
-// SimpleSerialShell::printHelp() is a static method.
-// printHelp() can access the linked list of commands.
-//
-int SimpleSerialShell::printHelp(int /*argc*/, char ** /*argv*/)
+int SimpleSerialShell::execute(int argc, char **argv)
 {
-    shell.println(F("Commands available are:"));
-    auto aCmd = firstCommand;  // first in list of commands.
-    while (aCmd)
-    {
-        aCmd->renderDocumentation(shell);
-        aCmd = aCmd->next;
+    m_lastErrNo = 0;
+    if (running >= SIMPLE_SERIAL_SHELL_MAX_DEPTH) {
+        return report(F("nested too deeply"), -1);
+    }
+    for (int i = 1; i < argc - 1; i++) {
+        if (strcmp(argv[i], "|") == 0) {
+            return runPipe(i, argc, argv);
+        }
+    }
+    Command * aCmd = resolveCommand(argc, argv);   // (argv[0] may be a group)
+    if (aCmd && (running > 0 || pipe || capturing)) {
+        // run by another command (or piped or captured): finish it here,
+        // even if asynchronous (only commands started at the top level
+        // are resumed later)
+        AsyncState state;
+        memset(&state, 0, sizeof(state));
+        bool outerTransferring = transferring;
+        running++;
+        do {
+            bool stopping = cancelRequested();
+            m_lastErrNo = aCmd->execute(argc, argv, state);
+            if (stopping && m_lastErrNo == PENDING) {
+                m_lastErrNo = CANCELLED;
+            }
+        } while (m_lastErrNo == PENDING);
+        running--;
+        transferring = outerTransferring;   // (a transfer ends with its command)
+        return m_lastErrNo;
+    }
+    if (aCmd) {
+        if (asyncCommand && aCmd->isAsynchronous()) {
+            // there's only room for one at a time
+            return report(F("busy"), -1);
+        }
+        // (a synchronous command mustn't disturb a pending one's state)
+        AsyncState syncState;
+        AsyncState & state = aCmd->isAsynchronous() ? asyncState : syncState;
+        memset(&state, 0, sizeof(state));
+        running++;
+        m_lastErrNo = aCmd->execute(argc, argv, state);
+        running--;
+        if (m_lastErrNo == PENDING && aCmd->isAsynchronous()) {
+            // finish it later (its argument strings must stay put)
+            asyncCommand = aCmd;
+            asyncArgc = argc;
+            memcpy(asyncArgv, argv, argc * sizeof(argv[0]));
+        } else {
+            cancelled = false;
+            if (aCmd->isAsynchronous()) {
+                transferring = false;   // (a transfer ends with its command)
+            }
+        }
+        return m_lastErrNo;
+    }
+    const char * alias = aliasArena ? findAlias(argv[0]) : NULL;
+    if (alias) {
+        m_lastErrNo = runAlias(alias, argc, argv);
+        if (!running) {
+            cancelled = false;
+        }
+        return m_lastErrNo;
     }
-    return 0;	// OK or "no errors"
+    return report(argv[0], F("command not found"), -1);
 }
 
-///////////////////////////////////////////////////////////////
-// i/o stream indirection/delegation
+//////////////////////////////////////////////////////////////////////////////
+// continue the unfinished command; returns true once it is done
 //
-size_t SimpleSerialShell::write(uint8_t aByte)
+bool SimpleSerialShell::resumeAsync(void)
 {
-    return shellConnection ?
-           shellConnection->write(aByte)
-           : 0;
+    // (checked first, so the command can see it and clean up)
+    bool stopping = cancelRequested();
+
+    running++;
+    int result = asyncCommand->execute(asyncArgc, asyncArgv, asyncState);
+    running--;
+    if (stopping) {
+        println(F("^C"));
+        result = CANCELLED;
+    } else if (result == PENDING) {
+        return false;
+    }
+    asyncCommand = NULL;
+    cancelled = false;
+    transferring = false;   // (however it stopped, mid-transfer or not)
+    m_lastErrNo = result;
+    if (asyncArgsHeld) {
+        lineArenaUsed -= asyncArgsHeld;     // done with its arguments
+        asyncArgsHeld = 0;
+    } else if (asyncArgv[0] >= linebuffer && asyncArgv[0] < linebuffer + sizeof(linebuffer)) {
+        resetBuffer();
+    }
+    return true;
 }
 
-int SimpleSerialShell::available()
+//////////////////////////////////////////////////////////////////////////////
+int SimpleSerialShell::capture(char * buffer, size_t size,
+                               const char * commandLine, size_t * length)
 {
-    return shellConnection ? shellConnection->available() : 0;
-}
+    Capture aCapture = {buffer, size, 0};
+    // (a capture inside a pipe's command takes that command's output)
+    Capture * outerCapture = capturing;
+    Pipe * outerPipe = pipe;
+    capturing = &aCapture;  // (so the command finishes here, even if asynchronous)
+    pipe = NULL;
+
+    int result = execute(commandLine);
+
+    capturing = outerCapture;
+    pipe = outerPipe;
+    if (!running) {
+        cancelled = false;
+    }
+    if (size > 0) {
+        buffer[(aCapture.length < size) ? aCapture.length : size - 1] = '\0';
+    }
+    if (length) {
+        *length = aCapture.length;
+    }
+    return result;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// "argv[0..bar-1] | argv[bar+1..]": run the command with its output going
+// through pipe->buffer to the filter, a bufferful at a time
+//
+int SimpleSerialShell::runPipe(int bar, int argc, char **argv)
+{
+    if (pipe) {
+        return report(F("only one pipe at a time"), -1);
+    }
+    int filterArgc = argc - bar - 1;
+    char ** filterArgv = argv + bar + 1;
+    Command * filter = resolveCommand(filterArgc, filterArgv);
+    bool found = findCommand(argv[0]) || (aliasArena && findAlias(argv[0]));
+    if (!filter || !found) {
+        return report(found ? argv[bar + 1] : argv[0], F("command not found"), -1);
+    }
+
+    Pipe aPipe;
+    memset(&aPipe, 0, sizeof(aPipe));
+    aPipe.filter = filter;
+    aPipe.argc = filterArgc;
+    aPipe.argv = filterArgv;
+    pipe = &aPipe;  // (so the command finishes here, even if asynchronous)
+
+    int result = execute(bar, argv);
+    aPipe.ended = true;
+    do {
+        runFilter();    // the rest of the output, then end of input
+    } while (!aPipe.done);
+
+    pipe = NULL;
+    if (!running) {
+        cancelled = false;
+    }
+    // (like "set -o pipefail": a failing command isn't hidden by the filter)
+    return m_lastErrNo = (result != EXIT_SUCCESS) ? result : aPipe.result;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// hand the filter what is in the pipe's buffer
+//
+void SimpleSerialShell::runFilter(void)
+{
+    Pipe & p = *pipe;
+    bool async = p.filter->isAsynchronous();
+    // a synchronous filter is only called when there is something to read
+    if (!p.done && (async || p.length > 0)) {
+        bool stopping = cancelRequested();
+        p.filtering = true;
+        running++;
+        int result = p.filter->execute(p.argc, p.argv, p.state);
+        running--;
+        p.filtering = false;
+        if (stopping && result == PENDING) {
+            result = CANCELLED;
+        }
+        if (result != PENDING) {
+            p.result = result;
+            p.done = async;
+        }
+    }
+    if (p.ended && !async) {
+        p.done = true;
+    }
+    p.length = p.readPos = 0;   // whatever it didn't read is lost
+}
+
+bool SimpleSerialShell::endOfInput(void)
+{
+    return !(pipe && pipe->filtering)
+           || (pipe->ended && pipe->readPos == pipe->length);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+bool SimpleSerialShell::cancelRequested(void)
+{
+    // (straight from the connection: a filter's input is the pipe)
+    if (!cancelled && (running || asyncCommand) && shellConnection && !transferring) {
+        int c;
+        while ((c = shellConnection->peek()) == '\n' || c == '\0') {
+            shellConnection->read();    // (ignored as input anyway: "\r\n" ends lines)
+        }
+        if (c == CTRL_C) {
+            shellConnection->read();    // consume it
+            cancelled = true;
+        }
+    }
+    return cancelled;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+bool SimpleSerialShell::isBusy(void)
+{
+    return asyncCommand != NULL;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+int SimpleSerialShell::lastErrNo(void)
+{
+    return m_lastErrNo;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+int SimpleSerialShell::report(const __FlashStringHelper * constMsg, int errorCode)
+{
+    return report(NULL, constMsg, errorCode);
+}
+
+int SimpleSerialShell::report(const char * name, const __FlashStringHelper * constMsg,
+                              int errorCode)
+{
+    if (errorCode != EXIT_SUCCESS && outputFormat != TEXT)
+    {
+        beginRecord(F("error"));
+        field(F("code"), errorCode);
+        field(F("name"), name ? name : "");
+        field(F("message"), constMsg);
+        endRecord();
+    }
+    else if (errorCode != EXIT_SUCCESS)
+    {
+        if (name) {
+            print(F("\""));
+            print(name);
+            print(F("\": "));
+        }
+        String message(constMsg);
+        print(errorCode);
+        if (message[0] != '\0') {
+            print(F(": "));
+            println(message);
+        }
+    }
+    m_lastErrNo = errorCode;
+    return errorCode;
+}
+//////////////////////////////////////////////////////////////////////////////
+void SimpleSerialShell::resetBuffer(void)
+{
+    memset(linebuffer, 0, sizeof(linebuffer));
+    inptr = 0;
+    cursor = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// SimpleSerialShell::printHelp() is a static method.
+// printHelp() can access the linked list of commands.
+//
+int SimpleSerialShell::printHelp(int argc, char ** argv)
+{
+    AsyncState state;
+    memset(&state, 0, sizeof(state));
+
+    int result;
+    do {
+        result = renderHelp(argc, argv, state);
+    } while (result == PENDING);
+    return result;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// The built-in "help" command.
+//
+// "help <prefix>" only lists commands starting with <prefix>.
+// "help <group> [<prefix>]" lists (matching) commands in a group.
+//
+// Help is rendered a few commands at a time; if there is more to list
+// than SIMPLE_SERIAL_SHELL_HELP_LINES, the rest follows on later calls
+// to executeIfInput().
+//
+int SimpleSerialShell::renderHelp(int argc, char ** argv, AsyncState & state)
+{
+    // (worked out again on each call; it's cheaper than keeping it)
+    Command * group = NULL;
+    argc--;
+    argv++;
+    for (Command * aGroup; argc > 0
+            && (aGroup = findCommand(argv[0], group ? group->children() : firstCommand))
+            && aGroup->isGroup(); argc--, argv++) {
+        group = aGroup;
+    }
+    const char * prefix = (argc > 0) ? argv[0] : NULL;
+    Command * aCmd = (Command *) state.pointer;
+
+    if (!aCmd) {
+        shell.println(F("Commands available are:"));
+
+        // the list is sorted, so matches are all together
+        aCmd = group ? group->children() : firstCommand;
+        while (aCmd && prefix && aCmd->comparePrefix(prefix) < 0) {
+            aCmd = aCmd->next;
+        }
+    }
+
+    for (int i = 0; aCmd && i < SIMPLE_SERIAL_SHELL_HELP_LINES; i++) {
+        if (prefix && aCmd->comparePrefix(prefix) != 0) {
+            aCmd = NULL;  // past the matching commands
+            break;
+        }
+        if (!aCmd->isRemoved()) {
+            aCmd->renderDocumentation(shell, shell.helpDictionary, group);
+        }
+        aCmd = aCmd->next;
+    }
+
+    state.pointer = aCmd;   // where to pick up next time
+    return aCmd ? PENDING : 0;	// OK or "no errors"
+}
+
+//////////////////////////////////////////////////////////////////////////////
+void SimpleSerialShell::setHelpDictionary(const __FlashStringHelper * dictionary)
+{
+    helpDictionary = (const char *) dictionary;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Periodic jobs ("every", "jobs", "kill").
+//
+// Active jobs are jobs[0..activeJobs), kept as a binary min-heap on their
+// due time, so checking whether anything needs to run is one comparison.
+//
+void SimpleSerialShell::addSchedulerCommands(Job jobTable[], uint8_t numJobs)
+{
+    jobs = jobTable;
+    maxJobs = numJobs;
+    activeJobs = 0;
+    addCommand(F("every <milliseconds> <command> [<args>...]"), everyCommand);
+    addCommand(F("jobs"), jobsCommand);
+    addCommand(F("kill <job>"), killCommand);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+static bool dueBefore(unsigned long a, unsigned long b)
+{
+    return (long)(a - b) < 0;   // (millis() rolls over)
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// move jobs[index] up or down the heap to where its due time belongs
+void SimpleSerialShell::siftJob(uint8_t index)
+{
+    Job moving = jobs[index];
+
+    while (index > 0) {
+        uint8_t parent = (index - 1) / 2;
+        if (!dueBefore(moving.due, jobs[parent].due)) {
+            break;
+        }
+        jobs[index] = jobs[parent];
+        index = parent;
+    }
+    for (;;) {
+        uint8_t child = 2 * index + 1;
+        if (child >= activeJobs) {
+            break;
+        }
+        if (child + 1 < activeJobs && dueBefore(jobs[child + 1].due, jobs[child].due)) {
+            child++;
+        }
+        if (!dueBefore(jobs[child].due, moving.due)) {
+            break;
+        }
+        jobs[index] = jobs[child];
+        index = child;
+    }
+    jobs[index] = moving;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+void SimpleSerialShell::runDueJobs(void)
+{
+    unsigned long now = millis();
+
+    // each job is rescheduled past "now" before it runs, so this ends
+    while (activeJobs > 0 && !dueBefore(now, jobs[0].due)) {
+        Job & job = jobs[0];
+
+        unsigned long late = (now - job.due) / job.period;
+        job.overruns += late;
+        job.due += (late + 1) * job.period;
+        job.runs++;
+
+        // the command may modify its arguments (or kill its own job)
+        char line[SIMPLE_SERIAL_SHELL_JOB_LINE];
+        char * argv[MAXARGS];
+        int argc = job.argc;
+        uint8_t id = job.id;
+        Command * aCmd = job.command;
+        memcpy(line, job.tokens, sizeof(line));
+        siftJob(0);
+
+        char * token = line;
+        for (int i = 0; i < argc; i++) {
+            argv[i] = token;
+            token += strlen(token) + 1;
+        }
+
+        AsyncState unused;
+        running++;
+        int result = aCmd->execute(argc, argv, unused);
+        running--;
+        if (!running) {
+            cancelled = false;
+        }
+
+        for (uint8_t i = 0; i < activeJobs; i++) {
+            if (jobs[i].id == id) {
+                jobs[i].lastResult = result;
+                break;
+            }
+        }
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+int SimpleSerialShell::everyCommand(int argc, char **argv)
+{
+    if (argc < 3) {
+        return shell.report(F("usage: every <milliseconds> <command> [<args>...]"), -1);
+    }
+    long period = atol(argv[1]);
+    if (period <= 0) {
+        return shell.report(F("bad period"), -1);
+    }
+    if (shell.activeJobs >= shell.maxJobs) {
+        return shell.report(F("no free job slots"), -1);
+    }
+    argc -= 2;
+    argv += 2;
+    Command * aCmd = resolveCommand(argc, argv);
+    if (!aCmd) {
+        return shell.report(F("command not found"), -1);
+    }
+    if (aCmd->isAsynchronous()) {
+        return shell.report(F("can't schedule an asynchronous command"), -1);
+    }
+
+    Job & job = shell.jobs[shell.activeJobs];
+    size_t used = 0;
+    for (int i = 0; i < argc; i++) {
+        size_t length = strlen(argv[i]) + 1;
+        if (used + length > sizeof(job.tokens)) {
+            return shell.report(F("command too long"), -1);
+        }
+        memcpy(job.tokens + used, argv[i], length);
+        used += length;
+    }
+
+    // pick an unused id
+    bool inUse;
+    do {
+        if (++shell.lastJobId == 0) {
+            shell.lastJobId = 1;
+        }
+        inUse = false;
+        for (uint8_t i = 0; i < shell.activeJobs; i++) {
+            inUse = inUse || shell.jobs[i].id == shell.lastJobId;
+        }
+    } while (inUse);
+
+    job.period = period;
+    job.due = millis() + period;
+    job.runs = 0;
+    job.overruns = 0;
+    job.command = aCmd;
+    job.lastResult = 0;
+    job.id = shell.lastJobId;
+    job.argc = argc;
+    shell.activeJobs++;
+    shell.siftJob(shell.activeJobs - 1);
+
+    shell.print(F("["));
+    shell.print(job.id);
+    shell.println(F("]"));
+    return EXIT_SUCCESS;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+int SimpleSerialShell::jobsCommand(int /*argc*/, char ** /*argv*/)
+{
+    for (uint8_t i = 0; i < shell.activeJobs; i++) {
+        const Job & job = shell.jobs[i];
+        shell.print(F("["));
+        shell.print(job.id);
+        shell.print(F("] every "));
+        shell.print(job.period);
+        const char * token = job.tokens;
+        for (uint8_t t = 0; t < job.argc; t++) {
+            shell.print(' ');
+            shell.print(token);
+            token += strlen(token) + 1;
+        }
+        shell.print(F(" (runs "));
+        shell.print(job.runs);
+        shell.print(F(", overruns "));
+        shell.print(job.overruns);
+        shell.print(F(", last "));
+        shell.print(job.lastResult);
+        shell.println(F(")"));
+    }
+    return EXIT_SUCCESS;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+int SimpleSerialShell::killCommand(int argc, char **argv)
+{
+    if (argc != 2) {
+        return shell.report(F("usage: kill <job>"), -1);
+    }
+    int id = atoi(argv[1]);
+    for (uint8_t i = 0; i < shell.activeJobs; i++) {
+        if (shell.jobs[i].id == id) {
+            shell.removeJob(i);
+            return EXIT_SUCCESS;
+        }
+    }
+    return shell.report(F("no such job"), -1);
+}
+
+void SimpleSerialShell::removeJob(uint8_t index)
+{
+    activeJobs--;
+    if (index < activeJobs) {
+        jobs[index] = jobs[activeJobs];
+        siftJob(index);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Aliases ("alias", "unalias").
+//
+// Each alias is one record, packed back to back in the arena:
+//
+//      uint16_t  length        of the whole record
+//      char      name[]        NUL terminated
+//      uint8_t   steps
+//      then for each step:
+//          Command * command   resolved when the alias was defined
+//          uint8_t   argc
+//          char      tokens[]  argc NUL terminated strings
+//
+// (multi-byte fields are unaligned, so they are copied with memcpy()).
+//
+void SimpleSerialShell::addAliasCommands(char arena[], size_t size)
+{
+    aliasArena = arena;
+    aliasArenaSize = size;
+    aliasUsed = 0;
+    addCommand(F("alias [<name> = <command> [<args>...] [&& <command>...]]"), aliasCommand);
+    addCommand(F("unalias <name>"), unaliasCommand);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+static uint16_t aliasLength(const char * record)
+{
+    uint16_t length;
+    memcpy(&length, record, sizeof(length));
+    return length;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+char * SimpleSerialShell::findAlias(const char * name)
+{
+    for (size_t at = 0; at < aliasUsed; at += aliasLength(aliasArena + at)) {
+        char * record = aliasArena + at;
+        if (strcasecmp(record + sizeof(uint16_t), name) == 0) {
+            return record;
+        }
+    }
+    return NULL;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+void SimpleSerialShell::removeAlias(char * record)
+{
+    uint16_t length = aliasLength(record);
+    char * end = aliasArena + aliasUsed;
+    memmove(record, record + length, end - (record + length));
+    aliasUsed -= length;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Runs the steps of an alias.  Arguments given to the alias are added to
+// the last step.  Stops at the first step that fails.
+int SimpleSerialShell::runAlias(const char * record, int argc, char **argv)
+{
+    const char * p = record + sizeof(uint16_t);
+    p += strlen(p) + 1;
+    uint8_t steps = *p++;
+
+    int result = EXIT_SUCCESS;
+    for (uint8_t step = 0; step < steps && result == EXIT_SUCCESS; step++) {
+        Command * aCmd;
+        memcpy(&aCmd, p, sizeof(aCmd));
+        p += sizeof(aCmd);
+        int stepArgc = (uint8_t) *p++;
+        if (!aCmd) {
+            return report(p, F("command removed"), -1);
+        }
+
+        // the command may modify its arguments; give it a copy
+        char tokens[SIMPLE_SERIAL_SHELL_BUFSIZE];
+        char * stepArgv[MAXARGS];
+        char * token = tokens;
+        for (int i = 0; i < stepArgc; i++) {
+            size_t length = strlen(p) + 1;
+            memcpy(token, p, length);
+            stepArgv[i] = token;
+            token += length;
+            p += length;
+        }
+        if (step == steps - 1) {
+            for (int i = 1; i < argc && stepArgc < MAXARGS; i++) {
+                stepArgv[stepArgc++] = argv[i];
+            }
+        }
+
+        AsyncState unused;
+        running++;
+        result = aCmd->execute(stepArgc, stepArgv, unused);
+        running--;
+    }
+    return result;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// point alias steps that run one command at another (NULL: removed)
+//
+void SimpleSerialShell::retargetAliases(const Command * from, Command * to)
+{
+    for (size_t at = 0; at < aliasUsed; at += aliasLength(aliasArena + at)) {
+        char * p = aliasArena + at + sizeof(uint16_t);
+        p += strlen(p) + 1;
+        for (uint8_t steps = *p++; steps > 0; steps--) {
+            Command * aCmd;
+            memcpy(&aCmd, p, sizeof(aCmd));
+            if (aCmd == from) {
+                memcpy(p, &to, sizeof(to));
+            }
+            p += sizeof(aCmd);
+            for (uint8_t tokens = *p++; tokens > 0; tokens--) {
+                p += strlen(p) + 1;
+            }
+        }
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+int SimpleSerialShell::aliasCommand(int argc, char **argv)
+{
+    SimpleSerialShell & s = shell;
+
+    if (argc == 1) {
+        // list them
+        for (size_t at = 0; at < s.aliasUsed; at += aliasLength(s.aliasArena + at)) {
+            const char * p = s.aliasArena + at + sizeof(uint16_t);
+            s.print(p);
+            s.print(F(" ="));
+            p += strlen(p) + 1;
+            uint8_t steps = *p++;
+            for (uint8_t step = 0; step < steps; step++) {
+                if (step > 0) {
+                    s.print(F(" &&"));
+                }
+                p += sizeof(Command *);
+                uint8_t stepArgc = *p++;
+                for (uint8_t i = 0; i < stepArgc; i++) {
+                    s.print(' ');
+                    s.print(p);
+                    p += strlen(p) + 1;
+                }
+            }
+            s.println();
+        }
+        return EXIT_SUCCESS;
+    }
+
+    if (argc < 4 || strcmp(argv[2], "=") != 0) {
+        return s.report(F("usage: alias <name> = <command> [<args>...] [&& <command>...]"), -1);
+    }
+    if (findCommand(argv[1])) {
+        return s.report(F("alias would hide a command"), -1);
+    }
+    char * previous = s.findAlias(argv[1]);  // replaced once this one is built
+
+    // build the record in the free end of the arena
+    char * record = s.aliasArena + s.aliasUsed;
+    size_t room = s.aliasArenaSize - s.aliasUsed;
+    size_t nameLength = strlen(argv[1]) + 1;
+    size_t length = sizeof(uint16_t) + nameLength + 1;
+    if (length > room) {
+        return s.report(F("alias space full"), -1);
+    }
+    memcpy(record + sizeof(uint16_t), argv[1], nameLength);
+    uint8_t & steps = (uint8_t &) record[length - 1];
+    steps = 0;
+
+    for (int i = 3; i < argc; ) {
+        int stepEnd = i;
+        while (stepEnd < argc && strcmp(argv[stepEnd], "&&") != 0) {
+            stepEnd++;
+        }
+        int tokens = stepEnd - i;
+        char ** step = argv + i;
+        Command * aCmd = resolveCommand(tokens, step);
+        i = stepEnd - tokens;   // past any group names
+        if (!aCmd) {
+            return s.report(argv[i], F("command not found"), -1);
+        }
+        if (aCmd->isAsynchronous()) {
+            return s.report(F("can't alias an asynchronous command"), -1);
+        }
+        if (length + sizeof(aCmd) + 1 > room) {
+            return s.report(F("alias space full"), -1);
+        }
+        memcpy(record + length, &aCmd, sizeof(aCmd));
+        length += sizeof(aCmd);
+        uint8_t & stepArgc = (uint8_t &) record[length++];
+        stepArgc = 0;
+
+        for ( ; i < argc && strcmp(argv[i], "&&") != 0; i++) {
+            size_t tokenLength = strlen(argv[i]) + 1;
+            if (length + tokenLength > room) {
+                return s.report(F("alias space full"), -1);
+            }
+            memcpy(record + length, argv[i], tokenLength);
+            length += tokenLength;
+            stepArgc++;
+        }
+        steps++;
+        i++;    // past "&&"
+    }
+
+    uint16_t recordLength = length;
+    memcpy(record, &recordLength, sizeof(recordLength));
+    s.aliasUsed += length;
+    if (previous) {
+        s.removeAlias(previous);
+    }
+    return EXIT_SUCCESS;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+int SimpleSerialShell::unaliasCommand(int argc, char **argv)
+{
+    if (argc != 2) {
+        return shell.report(F("usage: unalias <name>"), -1);
+    }
+    char * record = shell.findAlias(argv[1]);
+    if (!record) {
+        return shell.report(F("no such alias"), -1);
+    }
+    shell.removeAlias(record);
+    return EXIT_SUCCESS;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Binary telemetry subscriptions.
+//
+void SimpleSerialShell::addTelemetryCommands(Subscription subs[], uint8_t numSubs)
+{
+    subscriptions = subs;
+    maxSubscriptions = numSubs;
+    memset(subs, 0, numSubs * sizeof(subs[0]));
+    addCommand(F("unsubscribe [<id>]"), unsubscribeCommand);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+int SimpleSerialShell::subscribe(SamplerFunction sampler, unsigned long arg,
+                                 unsigned long periodMillis)
+{
+    Subscription * slot = NULL;
+    for (uint8_t i = 0; i < maxSubscriptions; i++) {
+        if (subscriptions[i].id == 0) {
+            slot = &subscriptions[i];
+            break;
+        }
+    }
+    if (!slot || !sampler) {
+        return -1;
+    }
+
+    // pick an unused id
+    bool inUse;
+    do {
+        if (++lastSubscriptionId == 0) {
+            lastSubscriptionId = 1;
+        }
+        inUse = false;
+        for (uint8_t i = 0; i < maxSubscriptions; i++) {
+            inUse = inUse || subscriptions[i].id == lastSubscriptionId;
+        }
+    } while (inUse);
+
+    memset(slot, 0, sizeof(*slot));
+    slot->sampler = sampler;
+    slot->arg = arg;
+    slot->period = periodMillis ? periodMillis : 1;
+    slot->due = slot->lastFrame = millis();
+    slot->id = lastSubscriptionId;
+    return slot->id;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+bool SimpleSerialShell::unsubscribe(int id)
+{
+    bool found = false;
+    for (uint8_t i = 0; i < maxSubscriptions; i++) {
+        if (subscriptions[i].id != 0 && (id == 0 || subscriptions[i].id == id)) {
+            subscriptions[i].id = 0;
+            found = true;
+        }
+    }
+    return found;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+int SimpleSerialShell::unsubscribeCommand(int argc, char **argv)
+{
+    if (argc > 2) {
+        return shell.report(F("usage: unsubscribe [<id>]"), -1);
+    }
+    int id = (argc == 2) ? atoi(argv[1]) : 0;
+    if (!shell.unsubscribe(id) && id != 0) {
+        return shell.report(F("no such subscription"), -1);
+    }
+    return EXIT_SUCCESS;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+uint16_t SimpleSerialShell::crc16(const void * data, size_t length, uint16_t crc)
+{
+    const uint8_t * p = (const uint8_t *) data;
+    while (length--) {
+        crc ^= (uint16_t) *p++ << 8;
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+        }
+    }
+    return crc;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+void SimpleSerialShell::sendTelemetry(void)
+{
+    static const uint8_t TELEMETRY_SYNC = 0xA5;
+    unsigned long now = millis();
+
+    for (uint8_t i = 0; i < maxSubscriptions; i++) {
+        Subscription & sub = subscriptions[i];
+        if (sub.id == 0 || dueBefore(now, sub.due)) {
+            continue;
+        }
+
+        // a fixed rate: samples we were too late for are skipped
+        unsigned long late = (now - sub.due) / sub.period;
+        sub.dropped += late;
+        sub.due += (late + 1) * sub.period;
+
+        int16_t values[SIMPLE_SERIAL_SHELL_TELEMETRY_VALUES];
+        uint8_t count = sub.sampler(values, sub.arg);
+        if (count > SIMPLE_SERIAL_SHELL_TELEMETRY_VALUES) {
+            count = SIMPLE_SERIAL_SHELL_TELEMETRY_VALUES;
+        }
+
+        // sync, id, count, delta (up to 5), values, crc
+        uint8_t frame[1 + 1 + 1 + 5 + 2 * SIMPLE_SERIAL_SHELL_TELEMETRY_VALUES + 2];
+        size_t n = 0;
+        frame[n++] = TELEMETRY_SYNC;
+        frame[n++] = sub.id;
+        frame[n++] = count;
+        unsigned long delta = now - sub.lastFrame;
+        do {
+            uint8_t b = delta & 0x7f;
+            delta >>= 7;
+            frame[n++] = delta ? (b | 0x80) : b;
+        } while (delta);
+        for (uint8_t v = 0; v < count; v++) {
+            frame[n++] = (uint16_t) values[v] & 0xff;
+            frame[n++] = (uint16_t) values[v] >> 8;
+        }
+        uint16_t crc = crc16(frame + 1, n - 1);
+        frame[n++] = crc & 0xff;
+        frame[n++] = crc >> 8;
+
+        // never send part of a frame
+        if (outQueue && outQueueSize - outCount < n) {
+            sub.dropped++;
+            continue;
+        }
+        write(frame, n);
+        sub.frames++;
+        sub.lastFrame = now;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+void SimpleSerialShell::setOutputQueue(uint8_t * buffer, size_t size)
+{
+    flush();    // send anything already queued
+    outQueue = size ? buffer : NULL;
+    outQueueSize = outQueue ? size : 0;
+    outHead = outCount = 0;
+    outDropped = stallMillis = 0;
+}
+
+size_t SimpleSerialShell::outputQueued(void)
+{
+    return outCount;
+}
+
+unsigned long SimpleSerialShell::outputDropped(void)
+{
+    return outDropped;
+}
+
+unsigned long SimpleSerialShell::outputStallMillis(void)
+{
+    unsigned long stalled = stallMillis;
+    if (outCount) {
+        stalled += millis() - stallStart;
+    }
+    return stalled;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// send as much queued output as the connection will take without blocking
+//
+void SimpleSerialShell::drainOutput(void)
+{
+    if (!outCount || !shellConnection) {
+        return;
+    }
+
+    int room = shellConnection->availableForWrite();
+    while (outCount && room > 0) {
+        size_t chunk = outQueueSize - outHead;  // contiguous part
+        if (chunk > outCount) {
+            chunk = outCount;
+        }
+        if (chunk > (size_t) room) {
+            chunk = room;
+        }
+        size_t sent = shellConnection->write(outQueue + outHead, chunk);
+        if (sent == 0) {
+            break;
+        }
+        outHead = (outHead + sent) % outQueueSize;
+        outCount -= sent;
+        room -= sent;
+    }
+
+    if (!outCount) {
+        stallMillis += millis() - stallStart;   // no longer waiting
+    }
+}
+
+///////////////////////////////////////////////////////////////
+// i/o stream indirection/delegation
+//
+size_t SimpleSerialShell::write(uint8_t aByte)
+{
+    return write(&aByte, 1);
+}
+
+size_t SimpleSerialShell::write(const uint8_t * buffer, size_t size)
+{
+    if (muted) {
+        return size;
+    }
+    if (pipe && !pipe->filtering) {
+        // a piped command's output goes to the filter
+        for (size_t i = 0; i < size; i++) {
+            if (pipe->length == sizeof(pipe->buffer)) {
+                runFilter();
+            }
+            pipe->buffer[pipe->length++] = buffer[i];
+        }
+        return size;
+    }
+    if (capturing) {
+        for (size_t i = 0; i < size; i++, capturing->length++) {
+            if (capturing->length + 1 < capturing->size) {
+                capturing->buffer[capturing->length] = buffer[i];
+            }
+        }
+        return size;
+    }
+    if (responding) {
+        // (kept in case its line is repeated)
+        responseCrc = crc16(buffer, size, responseCrc);
+        for (size_t i = 0; i < size; i++, lastResponseLength++) {
+            if (lastResponseLength < sizeof(lastResponse)) {
+                lastResponse[lastResponseLength] = buffer[i];
+            }
+        }
+    }
+    if (!shellConnection) {
+        return 0;
+    }
+    if (!outQueue) {
+        return shellConnection->write(buffer, size);
+    }
+
+    // report everything as "written" so Print does not stop early;
+    // anything that does not fit is counted in outputDropped()
+    const size_t requested = size;
+
+    drainOutput();  // keep output in order
+    if (outCount == 0) {
+        // nothing waiting; send what fits right away
+        int room = shellConnection->availableForWrite();
+        if (room > 0) {
+            size_t direct = ((size_t) room < size) ? (size_t) room : size;
+            direct = shellConnection->write(buffer, direct);
+            buffer += direct;
+            size -= direct;
+        }
+    }
+
+    if (size && outCount == 0) {
+        stallStart = millis();  // output starts waiting for room
+    }
+    for ( ; size && outCount < outQueueSize; size--) {
+        outQueue[(outHead + outCount++) % outQueueSize] = *buffer++;
+    }
+    outDropped += size;
+
+    return requested;
+}
+
+int SimpleSerialShell::availableForWrite()
+{
+    if (pipe && !pipe->filtering) {
+        return sizeof(pipe->buffer);    // never blocks
+    }
+    if (capturing) {
+        return capturing->size;         // never blocks (but may truncate)
+    }
+    if (outQueue) {
+        return outQueueSize - outCount;
+    }
+    return shellConnection ? shellConnection->availableForWrite() : 0;
+}
+
+int SimpleSerialShell::available()
+{
+    if (pipe && pipe->filtering) {
+        return pipe->length - pipe->readPos;
+    }
+    return shellConnection ? shellConnection->available() : 0;
+}
 
 int SimpleSerialShell::read()
 {
+    if (pipe && pipe->filtering) {
+        return (pipe->readPos < pipe->length) ? pipe->buffer[pipe->readPos++] : -1;
+    }
     return shellConnection ? shellConnection->read() : 0;
 }
 
 int SimpleSerialShell::peek()
 {
+    if (pipe && pipe->filtering) {
+        return (pipe->readPos < pipe->length) ? pipe->buffer[pipe->readPos] : -1;
+    }
     return shellConnection ? shellConnection->peek() : 0;
 }
 
 void SimpleSerialShell::flush()
 {
-    if (shellConnection)
+    if (shellConnection) {
+        // hand over anything queued, even if that means blocking
+        if (outCount) {
+            stallMillis += millis() - stallStart;
+        }
+        while (outCount) {
+            size_t chunk = outQueueSize - outHead;
+            if (chunk > outCount) {
+                chunk = outCount;
+            }
+            shellConnection->write(outQueue + outHead, chunk);
+            outHead = (outHead + chunk) % outQueueSize;
+            outCount -= chunk;
+        }
         shellConnection->flush();
+    }
 }
 
 void SimpleSerialShell::setTokenizer(TokenizerFunction f)
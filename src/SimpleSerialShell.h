@@ -1,11 +1,79 @@
-
 #ifndef SIMPLE_SERIAL_SHELL_H
 #define SIMPLE_SERIAL_SHELL_H
 
+#include <limits.h>
+#include <stdarg.h>
+
 #ifndef SIMPLE_SERIAL_SHELL_BUFSIZE
 #define SIMPLE_SERIAL_SHELL_BUFSIZE 88
 #endif
 
+// how deeply commands may run other commands (shell.execute() in a command)
+#ifndef SIMPLE_SERIAL_SHELL_MAX_DEPTH
+#define SIMPLE_SERIAL_SHELL_MAX_DEPTH 4
+#endif
+
+// room for the command lines given to execute(const char[]) while they run;
+// nested calls share it, each taking only what its line needs
+#ifndef SIMPLE_SERIAL_SHELL_NESTED_BUFSIZE
+#define SIMPLE_SERIAL_SHELL_NESTED_BUFSIZE SIMPLE_SERIAL_SHELL_BUFSIZE
+#endif
+
+// longest command line (in bytes) a scheduled job can store
+#ifndef SIMPLE_SERIAL_SHELL_JOB_LINE
+#define SIMPLE_SERIAL_SHELL_JOB_LINE 32
+#endif
+
+// most values one telemetry frame can carry
+#ifndef SIMPLE_SERIAL_SHELL_TELEMETRY_VALUES
+#define SIMPLE_SERIAL_SHELL_TELEMETRY_VALUES 8
+#endif
+
+// bytes of a pipe's first command's output handed to its filter at a time
+#ifndef SIMPLE_SERIAL_SHELL_PIPE_BUFSIZE
+#define SIMPLE_SERIAL_SHELL_PIPE_BUFSIZE 32
+#endif
+
+// room for a symbol table name, including its terminator
+#ifndef SIMPLE_SERIAL_SHELL_SYMBOL_LENGTH
+#define SIMPLE_SERIAL_SHELL_SYMBOL_LENGTH 12
+#endif
+
+// data bytes per block transfer frame (at most 250; see sendBlocks())
+#ifndef SIMPLE_SERIAL_SHELL_BLOCK_SIZE
+#define SIMPLE_SERIAL_SHELL_BLOCK_SIZE 32
+#endif
+
+// block transfer frames sent before waiting for an acknowledgement (at most 128)
+#ifndef SIMPLE_SERIAL_SHELL_BLOCK_WINDOW
+#define SIMPLE_SERIAL_SHELL_BLOCK_WINDOW 4
+#endif
+
+// how long (in milliseconds) a block transfer waits for the other end
+// before trying again, and how many times it tries
+#ifndef SIMPLE_SERIAL_SHELL_BLOCK_TIMEOUT
+#define SIMPLE_SERIAL_SHELL_BLOCK_TIMEOUT 1000
+#endif
+#ifndef SIMPLE_SERIAL_SHELL_BLOCK_RETRIES
+#define SIMPLE_SERIAL_SHELL_BLOCK_RETRIES 5
+#endif
+
+// stack buffer printf() formats into; longer output goes out in pieces
+#ifndef SIMPLE_SERIAL_SHELL_PRINTF_BUFSIZE
+#define SIMPLE_SERIAL_SHELL_PRINTF_BUFSIZE 48
+#endif
+
+// the last response kept to send again if its line is repeated (see
+// setLineChecks()); a longer one isn't kept
+#ifndef SIMPLE_SERIAL_SHELL_RESPONSE_BUFSIZE
+#define SIMPLE_SERIAL_SHELL_RESPONSE_BUFSIZE 64
+#endif
+
+// how many commands "help" lists per call to executeIfInput()
+#ifndef SIMPLE_SERIAL_SHELL_HELP_LINES
+#define SIMPLE_SERIAL_SHELL_HELP_LINES 8
+#endif
+
 ////////////////////////////////////////////////////////////////////////////////
 /*!
  *  @file SimpleSerialShell.h
@@ -20,6 +88,8 @@
 class SimpleSerialShell : public Stream {
     public:
 
+        class Command;  // (opaque) a registered command
+
         // The singleton instance of the shell
         static SimpleSerialShell theShell;
 
@@ -38,8 +108,112 @@ class SimpleSerialShell : public Stream {
          *   the help message.
          * @param f The command function that will be called when the command 
          *   is entered into the shell.
+         * @param group The group it belongs to (see addCommandGroup()), or
+         *   NULL for a top-level command.
+         */
+        void addCommand(const __FlashStringHelper * name, CommandFunction f,
+                        Command * group = NULL);
+
+        // A handler that serves several commands, told which by the
+        // context it was registered with:
+        // "int readSensor(int argc, char ** argv, void * context)"
+        typedef int (*ContextCommandFunction)(int, char **, void *);
+
+        /**
+         * @brief Registers a command that is passed a context pointer.
+         *
+         * One handler can then serve many instances (pins, sensors...),
+         * each registered with its own name and context, at the cost of a
+         * pointer of RAM each rather than a wrapper function of flash.
+         */
+        void addCommand(const __FlashStringHelper * name, ContextCommandFunction f,
+                        void * context, Command * group = NULL);
+
+        /**
+         * @brief Registers a group of commands, like "gpio" in "gpio read 5".
+         *
+         * Commands added to the group are found only after its name, in
+         * its own sorted list, so a lookup only walks the lists on its
+         * path.  Groups may hold groups.  A group alone lists its commands,
+         * as does "help <group>".
+         *
+         * @param name Group name, with optional documentation.
+         * @param group The enclosing group, or NULL for a top-level group.
+         * @return The group, for addCommand() and addAsyncCommand().
+         */
+        Command * addCommandGroup(const __FlashStringHelper * name,
+                                  Command * group = NULL);
+
+        // An asynchronous command returns PENDING until it is finished.
+        // It is called again (resumed) on each later call to
+        // executeIfInput(); the prompt and lastErrNo() wait until it
+        // returns something else.
+        static const int PENDING = INT_MIN;
+
+        // What an asynchronous command keeps between calls.  The
+        // SHELL_ASYNC_* macros below use resumeAt and since; pointer and
+        // locals are for the command's own use.  All start out zero.
+        struct AsyncState {
+            int resumeAt;
+            unsigned long since;
+            void * pointer;
+            long locals[2];
+        };
+
+        // "int slowHello(int argc, char ** argv, SimpleSerialShell::AsyncState & state)"
+        typedef int (*AsyncCommandFunction)(int, char **, AsyncState &);
+
+        /**
+         * @brief Registers an asynchronous (resumable) command.
+         *
+         * The function is called until it returns something other than
+         * PENDING.  Anything it needs across calls must be kept in its
+         * AsyncState (or in static variables); argv stays valid until it
+         * finishes.  Input is not read while it runs.
+         */
+        void addAsyncCommand(const __FlashStringHelper * name, AsyncCommandFunction f,
+                             Command * group = NULL);
+
+        bool isBusy(void);  // true while an asynchronous command is unfinished
+
+        /**
+         * @brief Unregisters a command, or a group with its commands.
+         *
+         * Safe to call from a running command (even the one removed): its
+         * storage is kept until nothing is running, then reused by the
+         * next command added.  Jobs running it are stopped, and aliases
+         * using it fail at that step.
+         *
+         * @param name The command's name.
+         * @param group The group it is in, or NULL for the top level.
+         * @return false if there is no such command.
          */
-        void addCommand(const __FlashStringHelper * name, CommandFunction f);
+        bool removeCommand(const char * name, Command * group = NULL);
+
+        /**
+         * @brief Registers a command in place of the one with the same
+         * name (or adds it, if there is none).
+         *
+         * Jobs and aliases using the old command run the new one.  Like
+         * removeCommand(), this is safe from a running command.
+         */
+        void replaceCommand(const __FlashStringHelper * name, CommandFunction f,
+                            Command * group = NULL);
+
+        // Returned by (and recorded for) a command stopped with Ctrl-C
+        // (like ECANCELED).
+        static const int CANCELLED = -125;
+
+        /**
+         * @brief Checks whether Ctrl-C was typed while a command is running.
+         *
+         * Long-running commands should poll this and return CANCELLED
+         * when it is true.  It is cheap: it only peeks at the next input
+         * character (so Ctrl-C is seen once any type-ahead before it has
+         * been read).  An asynchronous command that does not check is
+         * stopped by the shell after one last call.
+         */
+        bool cancelRequested(void);
 
         void attach(Stream & shellSource);
 
@@ -48,17 +222,426 @@ class SimpleSerialShell : public Stream {
         bool executeIfInput(void);  // returns true when command attempted
         int lastErrNo(void);
 
-        int execute( const char aCommandString[]);  // shell.execute("echo hello world");
+        // shell.execute("echo hello world");
+        // (works on a copy; a line being typed is left alone)
+        //
+        // Commands may run other commands this way, up to
+        // SIMPLE_SERIAL_SHELL_MAX_DEPTH deep; their own arguments are not
+        // disturbed.  An asynchronous command run by another command is
+        // finished before execute() returns.
+        int execute( const char aCommandString[]);
+
+        /**
+         * @brief Runs a command that is already split into arguments.
+         *
+         * Nothing is copied or parsed, and the line being typed is left
+         * alone.  If the command is asynchronous (returns PENDING), the
+         * argument strings must stay valid until isBusy() is false.
+         */
+        int execute(int argc, char ** argv);
+
+        // Splits line (in place: it is modified) and runs it.  Saves the
+        // copy execute(const char[]) makes.
+        int executeInPlace(char * line);
+
+        /**
+         * @brief Runs a command line with its output going into buffer
+         * instead of the connection.
+         *
+         * Like snprintf(), the output is cut to size - 1 bytes and always
+         * terminated, and length (if given) is set to how many bytes the
+         * command printed, so length >= size means it was truncated.  An
+         * asynchronous command is finished before capture() returns.
+         *
+         * @return The command's result.
+         */
+        int capture(char * buffer, size_t size, const char * commandLine,
+                    size_t * length = NULL);
+
+        /**
+         * @brief Formats output in a stack buffer and writes it at once,
+         * rather than a print() (and write()) per piece:
+         *
+         *      shell.printf(F("pin %d: %u.%02u V\r\n"), pin, volts, centivolts);
+         *
+         * Supports %d %i %u %x %X %c %s %% (and %ld, %lu, %lx...), %S for
+         * a flash string, and %f (precision up to 9, default 6; values
+         * beyond an unsigned long print as "ovf") without pulling in the
+         * C library's floating point printf.  Flags '-' and '0', widths
+         * and precisions (for %s, %S and %f) work as in printf().
+         *
+         * @return The number of bytes written.
+         */
+        size_t printf(const __FlashStringHelper * format, ...);
+        size_t printf(const char * format, ...);    // format in RAM
+
+        // How records (see beginRecord()) and error reports are printed.
+        enum OutputFormat {
+            TEXT,           // pin: 5, value: 512     (the default)
+            JSON_LINES,     // {"record":"analog","pin":5,"value":512}
+            CSV             // analog,5,512
+        };
+
+        // In JSON_LINES and CSV, input is not echoed and there is no
+        // prompt, so hosts see only output (ideally records).
+        void setOutputFormat(OutputFormat format);
+        OutputFormat getOutputFormat(void);
+
+        // Adds "format [{csv|json|text}]", which sets (or shows) it.
+        void addFormatCommand(void);
+
+        /**
+         * @brief Checks every command line, for noisy links (RS-485, BLE...).
+         *
+         * Lines must then be sent as
+         *
+         *      <seq> <command> [<args>...]*<crc>
+         *
+         * with seq two hex digits and crc four: the CRC-16/CCITT (see
+         * crc16()) of everything before the '*'.  A line that fails the
+         * check isn't run; the shell answers
+         *
+         *      -<seq>*<crc>            (seq is ?? if unreadable)
+         *
+         * so the host can send it again.  Otherwise, once the command has
+         * finished, its output ends with
+         *
+         *      +<seq> <result>*<crc>
+         *
+         * where crc covers all output since the line was accepted (but
+         * not scheduled jobs' or telemetry), up to the '*', so the host
+         * can tell whether the response was damaged.
+         * A line with the same seq as the last one accepted isn't run
+         * again: its response is sent again instead, or, if it was longer
+         * than SIMPLE_SERIAL_SHELL_RESPONSE_BUFSIZE, just
+         *
+         *      !<seq> <result>*<crc>
+         *
+         * (the output is gone; a new seq runs the command again).  Input
+         * is not echoed and there is no prompt.  (';' still ends a line.)
+         */
+        void setLineChecks(bool on);
+
+        /**
+         * @brief Starts a record: typed fields, printed as one line in the
+         * output format, so a handler formats its results once for people
+         * and host tools alike:
+         *
+         *      shell.beginRecord(F("analog"));
+         *      shell.field(F("pin"), pin);
+         *      shell.field(F("value"), analogRead(pin));
+         *      shell.endRecord();
+         *
+         * JSON_LINES gives each line a "record" member holding type, and
+         * escapes strings.  CSV starts each line with type, and has one
+         * column per field, in order (with strings quoted when they hold
+         * commas, quotes or line breaks).  Errors are reported as "error"
+         * records, with code, name and message fields.
+         */
+        void beginRecord(const __FlashStringHelper * type);
+        void field(const __FlashStringHelper * key, long value);
+        void field(const __FlashStringHelper * key, unsigned long value);
+        void field(const __FlashStringHelper * key, int value)
+        {
+            field(key, (long) value);
+        }
+        void field(const __FlashStringHelper * key, unsigned int value)
+        {
+            field(key, (unsigned long) value);
+        }
+        void field(const __FlashStringHelper * key, double value, uint8_t digits = 2);
+        void field(const __FlashStringHelper * key, bool value);
+        void field(const __FlashStringHelper * key, const char * value);
+        void field(const __FlashStringHelper * key, const __FlashStringHelper * value);
+        void endRecord(void);
 
+        // "help [<prefix>]" lists commands (starting with <prefix>).
+        // Typed at the shell, long listings continue on later calls to
+        // executeIfInput().  Called directly, it lists everything at once.
         static int printHelp(int argc, char **argv);
 
+        /**
+         * @brief Enables compressed command documentation.
+         *
+         * Bytes 0x80..0xFF in the documentation part of a command string
+         * refer to entry (byte - 0x80) of this dictionary, and are expanded
+         * as help is printed.  extras/tools/compressHelp.py generates both
+         * the dictionary and the compressed command strings.
+         *
+         * @param dictionary Packed PROGMEM entries: a length byte followed
+         *   by that many characters, repeated, ending with a zero length.
+         */
+        void setHelpDictionary(const __FlashStringHelper * dictionary);
+
         void resetBuffer(void);
 
+        /**
+         * @brief Keeps a history of command lines, recalled with the Up
+         * and Down arrow keys (Left and Right move within the line).
+         *
+         * Lines are stored back to back, so short lines cost little;
+         * the oldest are forgotten to make room for new ones.
+         *
+         * @param buffer Storage for the history, or NULL for none.
+         * @param size Size of the buffer in bytes.
+         */
+        void setHistory(char * buffer, size_t size);
+
+        // A periodic command run by the scheduler (see addSchedulerCommands()).
+        struct Job {
+            unsigned long period;       // milliseconds
+            unsigned long due;          // next run (millis())
+            unsigned long runs;
+            unsigned long overruns;     // periods skipped because we were late
+            Command * command;          // resolved when the job was created
+            int lastResult;
+            uint8_t id;
+            uint8_t argc;
+            char tokens[SIMPLE_SERIAL_SHELL_JOB_LINE];  // NUL separated argv
+        };
+
+        /**
+         * @brief Adds the "every", "jobs" and "kill" commands.
+         *
+         * "every <milliseconds> <command> [<args>...]" runs a command
+         * periodically from executeIfInput().  The command line is
+         * tokenized and its command looked up once, when the job is
+         * created.  "jobs" lists jobs with their run and overrun counts;
+         * "kill <id>" stops one.
+         *
+         * @param jobs Storage for up to numJobs jobs.
+         * @param numJobs How many jobs may run at once.
+         */
+        void addSchedulerCommands(Job jobs[], uint8_t numJobs);
+
+        /**
+         * @brief Adds the "alias" and "unalias" commands.
+         *
+         * "alias <name> = <command> [<args>...] [&& <command> ...]"
+         * defines a name for one or more commands.  Each step stops the
+         * alias if it fails (returns non-zero), and arguments given to the
+         * alias are added to its last step.  The definition is tokenized
+         * and its commands looked up once, so an alias runs without being
+         * parsed again.  "alias" alone lists them.
+         *
+         * @param arena Storage for the aliases, packed back to back.
+         * @param size Size of the arena in bytes.
+         */
+        void addAliasCommands(char arena[], size_t size);
+
+        // Fills values[] (up to SIMPLE_SERIAL_SHELL_TELEMETRY_VALUES of
+        // them) with one sample; returns how many it filled.
+        typedef uint8_t (*SamplerFunction)(int16_t values[], unsigned long arg);
+
+        // A stream of binary samples (see subscribe()).
+        struct Subscription {
+            SamplerFunction sampler;
+            unsigned long arg;          // passed to the sampler
+            unsigned long period;       // milliseconds
+            unsigned long due;          // next sample (millis())
+            unsigned long lastFrame;    // when the previous frame was sent
+            unsigned long frames;       // frames sent
+            unsigned long dropped;      // frames skipped (late, or no room)
+            uint8_t id;                 // 0 while the slot is free
+        };
+
+        /**
+         * @brief Provides storage for telemetry subscriptions and adds the
+         * "unsubscribe [<id>]" command.
+         */
+        void addTelemetryCommands(Subscription subscriptions[], uint8_t numSubscriptions);
+
+        /**
+         * @brief Streams binary samples to the attached stream every
+         * periodMillis, from executeIfInput(), until unsubscribed.
+         *
+         * Each sample is sent as one frame (integers little-endian):
+         *
+         *      0xA5        sync byte
+         *      id          subscription id
+         *      count       number of values
+         *      delta       milliseconds since this subscription's previous
+         *                  frame, as a base-128 varint (1 byte below 128)
+         *      values      count int16 values
+         *      crc         CRC-16/CCITT (see crc16()) of id..values
+         *
+         * A frame is only written when the output queue (if any) has room
+         * for all of it; otherwise it is counted as dropped.
+         *
+         * @return The subscription id (1..255), or -1 if all slots are in use.
+         */
+        int subscribe(SamplerFunction sampler, unsigned long arg, unsigned long periodMillis);
+        bool unsubscribe(int id);   // id 0 ends all subscriptions
+
+        /**
+         * @brief Adds the "grep <text>" and "wc" filters for pipes.
+         *
+         * "<command> [<args>...] | <filter> [<args>...]" runs the command
+         * with its output going to the filter instead of the connection.
+         * The output is handed over SIMPLE_SERIAL_SHELL_PIPE_BUFSIZE bytes
+         * at a time, so a filter runs in constant memory however much the
+         * command prints.  Any command can be a filter: it reads its input
+         * with read()/available().  A synchronous filter is called for each
+         * bufferful; an asynchronous one returns PENDING until
+         * endOfInput(), and gets at least one call.  Whatever a call
+         * doesn't read is lost.
+         */
+        void addFilterCommands(void);
+
+        // false only in a pipe's filter, until the command has finished
+        // and all of its output has been read
+        bool endOfInput(void);
+
+        // CRC-16/CCITT-FALSE (polynomial 0x1021), bit at a time: no table.
+        // Start with crc = 0xFFFF, or pass on a previous result to continue.
+        static uint16_t crc16(const void * data, size_t length, uint16_t crc = 0xFFFF);
+
+        // Reads the byte at address from some kind of memory, for dump().
+        typedef uint8_t (*ByteReader)(unsigned long address);
+        static uint8_t readRam(unsigned long address);
+        static uint8_t readProgmem(unsigned long address);
+
+        /**
+         * @brief Prints memory as rows of 16 bytes: the address and the
+         * bytes in hex, then the bytes as text ('.' if not printable).
+         *
+         *      1F0 48 65 6C 6C 6F 00 ... Hello.
+         *
+         * Each row is formatted in a buffer and written at once.  Stops
+         * early, returning CANCELLED, on Ctrl-C.
+         *
+         * @param reader Reads the memory: readRam, readProgmem, or your
+         *   own (for EEPROM, say).
+         */
+        int dump(ByteReader reader, unsigned long address, unsigned long length);
+
+        // Writes value to address in some kind of memory, for receiveBlocks().
+        typedef void (*ByteWriter)(unsigned long address, uint8_t value);
+        static void writeRam(unsigned long address, uint8_t value);
+
+        // The state of one block transfer (see beginTransfer()).
+        struct BlockTransfer {
+            unsigned long address;
+            unsigned long length;
+            unsigned long acked;        // frames acknowledged (or written)
+            unsigned long sent;         // frames sent
+            unsigned long lastHeard;    // millis() when last heard from
+            uint8_t retries;            // timeouts since last heard
+            uint8_t reply;              // ACK or NAK waiting for its seq
+            bool nakked;                // NAK sent for the frame expected
+            uint8_t received;           // bytes of frame so far
+            uint8_t frame[SIMPLE_SERIAL_SHELL_BLOCK_SIZE + 5];
+        };
+
+        /**
+         * @brief Switches the connection to binary frames for moving length
+         * bytes of memory from (or to) address, until sendBlocks() or
+         * receiveBlocks() finishes.
+         *
+         * Data goes in frames of SIMPLE_SERIAL_SHELL_BLOCK_SIZE bytes (the
+         * last one shorter, maybe empty, marking the end):
+         *
+         *      0xB5        sync byte
+         *      seq         frame number (mod 256)
+         *      len         data bytes
+         *      data        len bytes
+         *      crc         CRC-16/CCITT (see crc16()) of seq..data
+         *
+         * and the receiver answers with ACK (0x06) seq for all frames up to
+         * seq, or NAK (0x15) seq to have frames sent again from seq.  Up to
+         * SIMPLE_SERIAL_SHELL_BLOCK_WINDOW frames go unacknowledged.  A
+         * receiving device starts with NAK 0.  CAN (0x18) from either end
+         * stops the transfer; Ctrl-C does not (it may be data).  Jobs and
+         * telemetry wait until it's over.
+         */
+        void beginTransfer(BlockTransfer & transfer, unsigned long address,
+                           unsigned long length);
+
+        // Call from an asynchronous command until it returns something
+        // other than PENDING: EXIT_SUCCESS, CANCELLED, or -1 if the other
+        // end stopped answering.
+        int sendBlocks(BlockTransfer & transfer, ByteReader reader);
+        int receiveBlocks(BlockTransfer & transfer, ByteWriter writer);
+
+        // One name <-> value pair of a symbol table, for arguments that
+        // take names ("output", "high").  Declare tables constexpr and
+        // PROGMEM, with names sorted (ignoring case), and check it:
+        //
+        //  static constexpr SimpleSerialShell::Symbol modes[] PROGMEM = {
+        //      {"input", INPUT}, {"output", OUTPUT}, {"pullup", INPUT_PULLUP},
+        //  };
+        //  static_assert(SimpleSerialShell::symbolsSorted(modes), "sort modes");
+        //
+        struct Symbol {
+            char name[SIMPLE_SERIAL_SHELL_SYMBOL_LENGTH];   // (in the table)
+            int value;
+        };
+
+        template <size_t N>
+        static constexpr bool symbolsSorted(const Symbol (&table)[N])
+        {
+            return symbolsSorted(table, N);
+        }
+
+        static constexpr bool symbolsSorted(const Symbol * table, size_t count)
+        {
+            return count < 2
+                   || (compareSymbols(table[0].name, table[1].name) < 0
+                       && symbolsSorted(table + 1, count - 1));
+        }
+
+        // Finds name (ignoring case) by binary search; false if it isn't there.
+        static bool lookupSymbol(const char * name, const Symbol table[], size_t count,
+                                 int & value);
+        template <size_t N>
+        static bool lookupSymbol(const char * name, const Symbol (&table)[N], int & value)
+        {
+            return lookupSymbol(name, table, N, value);
+        }
+
+        // The (first) name for value, in flash, or NULL.
+        static const __FlashStringHelper * symbolName(int value, const Symbol table[],
+                                                     size_t count);
+        template <size_t N>
+        static const __FlashStringHelper * symbolName(int value, const Symbol (&table)[N])
+        {
+            return symbolName(value, table, N);
+        }
+
+        // Prints the names as "{input|output|pullup}", for usage messages.
+        static void printSymbols(Print & out, const Symbol table[], size_t count);
+        template <size_t N>
+        static void printSymbols(Print & out, const Symbol (&table)[N])
+        {
+            printSymbols(out, table, N);
+        }
+
+        /**
+         * @brief Queues output instead of blocking when the attached
+         * stream's transmit buffer is full.
+         *
+         * Output is written through as long as availableForWrite() reports
+         * room; the rest waits in the queue and drains on each call to
+         * executeIfInput().  If the queue fills, further output is dropped
+         * (and counted).  The attached stream must implement
+         * availableForWrite() (HardwareSerial does).
+         *
+         * @param buffer Storage for the queue, or NULL to stop queueing.
+         * @param size Size of the buffer in bytes.
+         */
+        void setOutputQueue(uint8_t * buffer, size_t size);
+        size_t outputQueued(void);              // bytes waiting to be sent
+        unsigned long outputDropped(void);      // bytes lost to overflow
+        unsigned long outputStallMillis(void);  // time spent unable to send
+
         // this shell delegates communication to/from the attached stream
         // (which sent the command)
         // Note changing streams may intermix serial data
         //
+        using Print::write;
         virtual size_t write(uint8_t);
+        virtual size_t write(const uint8_t * buffer, size_t size);
+        virtual int availableForWrite();
         virtual int available();
         virtual int read();
         virtual int peek();
@@ -86,27 +669,213 @@ class SimpleSerialShell : public Stream {
 
         SimpleSerialShell(void);
 
+        // (like strcasecmp(), at compile time)
+        static constexpr char symbolLower(char c)
+        {
+            return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+        }
+
+        static constexpr int compareSymbols(const char * a, const char * b)
+        {
+            return (symbolLower(*a) != symbolLower(*b) || *a == '\0')
+                   ? symbolLower(*a) - symbolLower(*b)
+                   : compareSymbols(a + 1, b + 1);
+        }
+
         Stream * shellConnection;
         int m_lastErrNo;
         int execute(void);
-        int execute(int argc, char** argv);
 
         bool prepInput(void);
+        void drainOutput(void);
+        void insertCommand(Command * newCmd, Command * group);
+
+        // removed commands are marked, and reclaimed once none can be running
+        static Command * freeCommands;
+        bool commandsRemoved;
+        static Command * allocateCommand(const Command & prototype);
+        void retireCommand(Command * aCmd, Command * replacement);
+        void reclaimCommands(void);
+        static void sweepCommands(Command ** list);
 
         int report(const __FlashStringHelper * message, int errorCode);
+        // ("name": message, for a command or alias)
+        int report(const char * name, const __FlashStringHelper * message, int errorCode);
         static const char MAXARGS = 10;
         char linebuffer[SIMPLE_SERIAL_SHELL_BUFSIZE];
-        int inptr;
+        int inptr;      // length of the line
+        int cursor;     // where typing goes (<= inptr)
 
-        class Command;
         static Command * firstCommand;
 
         TokenizerFunction tokenizer;
+
+        const char * helpDictionary;
+        static int renderHelp(int argc, char **argv, AsyncState & state);
+
+        // the unfinished asynchronous command, if any
+        Command * asyncCommand;
+        int asyncArgc;
+        char * asyncArgv[MAXARGS];
+        size_t asyncArgsHeld;   // lineArena bytes its arguments hold
+        AsyncState asyncState;
+        bool resumeAsync(void);
+        friend class StartupScript;     // (finishes its lines with resumeAsync())
+
+        uint8_t running;    // commands currently executing
+        bool cancelled;     // Ctrl-C seen while running
+
+        static Command * findCommand(const char * name, Command * list = firstCommand);
+        static Command * resolveCommand(int & argc, char **& argv);
+        static int listGroup(const Command * group, int argc, char **argv);
+
+        // the running "command | filter", if any
+        struct Pipe;
+        Pipe * pipe;
+
+        // where capture() is putting output
+        struct Capture;
+        Capture * capturing;
+        int runPipe(int bar, int argc, char **argv);
+
+        // records (see beginRecord())
+        OutputFormat outputFormat;
+        uint8_t recordFields;   // in the record so far
+        bool muted;             // (not echoing input)
+
+        // line checks (see setLineChecks())
+        bool lineChecks;
+        int lineSeq;            // of the last line accepted, or -1
+        int lineResult;         // its command's result
+        bool responding;        // from accepting a line to its status line
+        uint16_t responseCrc;   // of the output since
+        uint8_t lastResponse[SIMPLE_SERIAL_SHELL_RESPONSE_BUFSIZE];
+        size_t lastResponseLength;  // (more than fits: it wasn't kept)
+        bool checkLine(void);
+        void sendLineStatus(char status, int seq, int result);
+        void commandDone(void);
+        void fieldKey(const __FlashStringHelper * key);
+        void writeString(const char * text, bool inFlash);
+        static int formatCommand(int argc, char **argv);
+
+        struct FormatBuffer;
+        size_t formatOut(const char * format, bool inFlash, va_list args);
+
+        bool transferring;  // between beginTransfer() and its end
+        int endTransfer(int result);
+        void sendFrame(BlockTransfer & transfer, unsigned long index, ByteReader reader);
+        void sendReply(uint8_t reply, unsigned long index);
+        bool transferTimedOut(BlockTransfer & transfer);
+        void runFilter(void);
+
+        // scheduled jobs, kept as a min-heap on Job::due
+        Job * jobs;
+        uint8_t maxJobs;
+        uint8_t activeJobs;
+        uint8_t lastJobId;
+        void runDueJobs(void);
+        void siftJob(uint8_t index);
+        void removeJob(uint8_t index);
+        static int everyCommand(int argc, char **argv);
+        static int jobsCommand(int argc, char **argv);
+        static int killCommand(int argc, char **argv);
+
+        // telemetry subscriptions
+        Subscription * subscriptions;
+        uint8_t maxSubscriptions;
+        uint8_t lastSubscriptionId;
+        void sendTelemetry(void);
+        static int unsubscribeCommand(int argc, char **argv);
+
+        // aliases, packed in a caller-provided arena
+        char * aliasArena;
+        size_t aliasArenaSize;
+        size_t aliasUsed;
+        char * findAlias(const char * name);
+        void removeAlias(char * record);
+        int runAlias(const char * record, int argc, char **argv);
+        void retargetAliases(const Command * from, Command * to);
+        static int aliasCommand(int argc, char **argv);
+        static int unaliasCommand(int argc, char **argv);
+
+        // line editing and history (see setHistory())
+        char * history;
+        size_t historySize;
+        size_t historyStart;    // the oldest line
+        size_t historyUsed;
+        int historyRecall;      // line shown (0: not recalled)
+        uint8_t escape;         // escape sequence state: 0, ESC, '[' or 'O'
+        void moveCursor(int from, int to);
+        void arrowKey(int c);
+        bool historyLine(int n, char * line);
+        void recallHistory(int n);
+        void remember(void);
+
+        // copies of nested execute(const char[]) lines, used like a stack
+        char lineArena[SIMPLE_SERIAL_SHELL_NESTED_BUFSIZE];
+        size_t lineArenaUsed;
+
+        // optional output queue (see setOutputQueue())
+        uint8_t * outQueue;
+        size_t outQueueSize;
+        size_t outHead;
+        size_t outCount;
+        unsigned long outDropped;
+        unsigned long stallStart;
+        unsigned long stallMillis;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
 extern SimpleSerialShell& shell;
 
+////////////////////////////////////////////////////////////////////////////////
+// Helpers for writing asynchronous commands as stackless coroutines
+// (in the style of protothreads):
+//
+//  int blink3(int argc, char **argv, SimpleSerialShell::AsyncState & state)
+//  {
+//      SHELL_ASYNC_BEGIN(state);
+//      for (state.locals[0] = 0; state.locals[0] < 3; state.locals[0]++) {
+//          digitalWrite(LED_BUILTIN, HIGH);
+//          SHELL_ASYNC_SLEEP(state, 500);
+//          digitalWrite(LED_BUILTIN, LOW);
+//          SHELL_ASYNC_SLEEP(state, 500);
+//      }
+//      SHELL_ASYNC_END(state);
+//      return EXIT_SUCCESS;
+//  }
+//
+// Local variables do not survive a yield; keep them in the AsyncState.
+// Don't use switch statements between BEGIN and END.
+//
+#define SHELL_ASYNC_BEGIN(state) switch ((state).resumeAt) { case 0:
+
+#define SHELL_ASYNC_YIELD(state) \
+    do { \
+        (state).resumeAt = __LINE__; \
+        return SimpleSerialShell::PENDING; \
+        case __LINE__:; \
+    } while (0)
+
+#define SHELL_ASYNC_WAIT_UNTIL(state, condition) \
+    do { \
+        (state).resumeAt = __LINE__; \
+        if (false) { \
+            case __LINE__:; /* resume here */ \
+        } \
+        if (!(condition)) { \
+            return SimpleSerialShell::PENDING; \
+        } \
+    } while (0)
+
+#define SHELL_ASYNC_SLEEP(state, milliseconds) \
+    do { \
+        (state).since = millis(); \
+        SHELL_ASYNC_WAIT_UNTIL(state, millis() - (state).since >= (unsigned long) (milliseconds)); \
+    } while (0)
+
+#define SHELL_ASYNC_END(state) } (state).resumeAt = 0
+
 //example commands which would be easy to add to the shell:
 //extern int helloWorld(int argc, char **argv);
 //extern int echo(int argc, char **argv);
@@ -0,0 +1,201 @@
+#include <Arduino.h>
+#include <StartupScript.h>
+
+////////////////////////////////////////////////////////////////////////////////
+/*!
+ *  @file StartupScript.cpp
+ *
+ *  Implementation for the startup script.
+ *
+ */
+
+static const uint8_t magic[2] = { 'S', 'S' };
+
+// the script the "startup" command works on
+static StartupScript * theScript = NULL;
+
+//////////////////////////////////////////////////////////////////////////////
+StartupScript::StartupScript(ShellStorage & aStorage, size_t anOffset)
+    : storage(aStorage),
+      offset(anOffset),
+      running(false)
+{
+}
+
+//////////////////////////////////////////////////////////////////////////////
+void StartupScript::addCommands(SimpleSerialShell & shell)
+{
+    theScript = this;
+    shell.addCommand(F("startup {list|add|clear|run} [<command>...]"), startupCommand);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+uint16_t StartupScript::read16(size_t at)
+{
+    return storage.read(offset + at) | (storage.read(offset + at + 1) << 8);
+}
+
+void StartupScript::write16(size_t at, uint16_t value)
+{
+    storage.write(offset + at, value & 0xff);
+    storage.write(offset + at + 1, value >> 8);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+uint16_t StartupScript::textCrc(uint16_t length)
+{
+    uint16_t crc = 0xFFFF;
+    for (uint16_t i = 0; i < length; i++) {
+        uint8_t b = storage.read(offset + HEADER + i);
+        crc = SimpleSerialShell::crc16(&b, 1, crc);
+    }
+    return crc;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// true if a script is stored (and intact); sets the length of its text
+bool StartupScript::readHeader(uint16_t & length)
+{
+    length = 0;
+    if (storage.length() < offset + HEADER
+            || storage.read(offset) != magic[0]
+            || storage.read(offset + 1) != magic[1]) {
+        return false;
+    }
+    uint16_t stored = read16(2);
+    if (offset + HEADER + stored > storage.length()
+            || textCrc(stored) != read16(4)) {
+        return false;
+    }
+    length = stored;
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+void StartupScript::writeHeader(uint16_t length)
+{
+    storage.write(offset, magic[0]);
+    storage.write(offset + 1, magic[1]);
+    write16(2, length);
+    write16(4, textCrc(length));
+    storage.commit();
+}
+
+//////////////////////////////////////////////////////////////////////////////
+bool StartupScript::isValid(void)
+{
+    uint16_t length;
+    return readHeader(length);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+bool StartupScript::append(const char * line)
+{
+    uint16_t length;
+    readHeader(length);     // (starts a new script if there is none)
+    size_t lineLength = strlen(line) + 1;
+    if (lineLength > SIMPLE_SERIAL_SHELL_BUFSIZE
+            || offset + HEADER + length + lineLength > storage.length()) {
+        return false;
+    }
+    for (size_t i = 0; i < lineLength; i++) {
+        storage.write(offset + HEADER + length + i, line[i]);
+    }
+    writeHeader(length + lineLength);
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+void StartupScript::clear(void)
+{
+    writeHeader(0);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+void StartupScript::list(Print & out)
+{
+    uint16_t length;
+    readHeader(length);
+    for (uint16_t i = 0; i < length; i++) {
+        uint8_t c = storage.read(offset + HEADER + i);
+        if (c) {
+            out.write(c);
+        } else {
+            out.println();
+        }
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+int StartupScript::run(SimpleSerialShell & shell)
+{
+    uint16_t length;
+    if (!readHeader(length) || running) {
+        return -1;  // nothing to run (or "startup run" is in the script)
+    }
+    running = true;
+    int failures = 0;
+    char line[SIMPLE_SERIAL_SHELL_BUFSIZE];
+
+    for (uint16_t at = 0; at < length; ) {
+        size_t n = 0;
+        uint8_t c;
+        while ((c = storage.read(offset + HEADER + at++)) != 0) {
+            if (n < sizeof(line) - 1) {
+                line[n++] = c;
+            }
+        }
+        line[n] = '\0';
+
+        int result = shell.executeInPlace(line);
+        if (result == SimpleSerialShell::PENDING) {
+            // finish it here: no prompt, no jobs, and no input read
+            while (!shell.resumeAsync()) {
+            }
+            result = shell.lastErrNo();
+        }
+        failures += (result != EXIT_SUCCESS);
+    }
+    running = false;
+    return failures;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+int StartupScript::startupCommand(int argc, char **argv)
+{
+    StartupScript & script = *theScript;
+
+    if (argc == 1 || (argc == 2 && strcmp(argv[1], "list") == 0)) {
+        script.list(shell);
+        return EXIT_SUCCESS;
+    }
+    if (argc > 2 && strcmp(argv[1], "add") == 0) {
+        // put the words back together
+        char line[SIMPLE_SERIAL_SHELL_BUFSIZE];
+        line[0] = '\0';
+        for (int i = 2; i < argc; i++) {
+            if (strlen(line) + strlen(argv[i]) + 2 > sizeof(line)) {
+                shell.println(F("startup: line too long"));
+                return -1;
+            }
+            if (i > 2) {
+                strcat(line, " ");
+            }
+            strcat(line, argv[i]);
+        }
+        if (!script.append(line)) {
+            shell.println(F("startup: storage full"));
+            return -1;
+        }
+        return EXIT_SUCCESS;
+    }
+    if (argc == 2 && strcmp(argv[1], "clear") == 0) {
+        script.clear();
+        return EXIT_SUCCESS;
+    }
+    if (argc == 2 && strcmp(argv[1], "run") == 0) {
+        return script.run(shell);
+    }
+    shell.println(F("usage: startup {list|add|clear|run} [<command>...]"));
+    return -1;
+}
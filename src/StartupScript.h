@@ -0,0 +1,88 @@
+#ifndef STARTUP_SCRIPT_H
+#define STARTUP_SCRIPT_H
+
+#include <Arduino.h>
+#include <SimpleSerialShell.h>
+
+////////////////////////////////////////////////////////////////////////////////
+/*!
+ *  @file StartupScript.h
+ *
+ *  Keep a list of command lines in non-volatile storage, and run them at
+ *  startup.
+ *
+ *  @section format Storage format
+ *
+ *      magic    2 bytes "SS"
+ *      length   2 bytes, little-endian: bytes of text
+ *      crc      2 bytes, little-endian: SimpleSerialShell::crc16() of text
+ *      text     the command lines, each terminated by a NUL
+ *
+ *  Lines are kept as text (not resolved commands), so a script still
+ *  works after the sketch is rebuilt.
+ */
+
+////////////////////////////////////////////////////////////////////////////////
+/*!
+ *  @brief Byte-addressed non-volatile storage (EEPROM, flash emulation, a
+ *  file...).
+ *
+ *  For example, on AVR:
+ *
+ *      class EepromStorage : public ShellStorage {
+ *          size_t length() { return EEPROM.length(); }
+ *          uint8_t read(size_t address) { return EEPROM.read(address); }
+ *          void write(size_t address, uint8_t value) { EEPROM.update(address, value); }
+ *      };
+ */
+class ShellStorage {
+    public:
+        virtual size_t length() = 0;
+        virtual uint8_t read(size_t address) = 0;
+        virtual void write(size_t address, uint8_t value) = 0;
+        virtual void commit() {}    // e.g. EEPROM.commit() on ESP32/ESP8266
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/*!
+ *  @brief Command lines to run at startup.
+ *
+ *      StartupScript startup(eepromStorage);
+ *      ...
+ *      startup.addCommands(shell);     // "startup ..."
+ *      startup.run(shell);             // before reading any input
+ */
+class StartupScript {
+    public:
+        // The script occupies storage from offset to the end.
+        StartupScript(ShellStorage & storage, size_t offset = 0);
+
+        // Adds "startup {list|add|clear|run} [<command>...]".
+        void addCommands(SimpleSerialShell & shell);
+
+        // Runs every line (waiting for asynchronous commands to finish).
+        // Returns how many lines failed, or -1 if no valid script is stored.
+        int run(SimpleSerialShell & shell);
+
+        bool isValid(void);                 // a script with a good checksum?
+        bool append(const char * line);     // false if storage is full
+        void clear(void);
+        void list(Print & out);
+
+    private:
+        static const size_t HEADER = 6;
+
+        bool readHeader(uint16_t & length);
+        uint16_t textCrc(uint16_t length);
+        void writeHeader(uint16_t length);
+        uint16_t read16(size_t at);
+        void write16(size_t at, uint16_t value);
+
+        static int startupCommand(int argc, char **argv);
+
+        ShellStorage & storage;
+        size_t offset;
+        bool running;
+};
+
+#endif /* STARTUP_SCRIPT_H */